@@ -41,6 +41,7 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include <workq.h>
 
 
 /* in exception-*.S */
@@ -193,8 +194,23 @@ mips_trap(struct trapframe *tf)
 			doadjust = false;
 		}
 
+		curcpu->c_intr_user = !iskern;
+		curcpu->c_intr_pc = tf->tf_epc;
 		mainbus_interrupt(tf);
 
+		/*
+		 * Now run any work the handlers deferred (see
+		 * workq.h), with interrupts back on. Only the
+		 * outermost interrupt does this, and only if what it
+		 * interrupted was running at spl0; the idle loop
+		 * takes care of the rest.
+		 */
+		if (doadjust && !old_in) {
+			spl0();
+			workq_run();
+			splhigh();
+		}
+
 		if (doadjust) {
 			KASSERT(curthread->t_curspl == IPL_HIGH);
 			KASSERT(curthread->t_iplhigh_count == 1);
@@ -370,6 +386,7 @@ mips_trap(struct trapframe *tf)
  * outside the mips port, but should be called from one of the
  * following places:
  *    - enter_new_process, for use by exec and equivalent.
+ *    - enter_new_thread, for use by threadfork.
  *    - enter_forked_process, in syscall.c, for use by fork.
  */
 void
@@ -444,3 +461,22 @@ enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 	mips_usermode(&tf);
 }
+
+/*
+ * enter_new_thread: go to user mode in a new thread of an existing
+ * process, calling ENTRY with ARG on the given stack.
+ */
+void
+enter_new_thread(userptr_t arg, vaddr_t stack, vaddr_t entry)
+{
+	struct trapframe tf;
+
+	bzero(&tf, sizeof(tf));
+
+	tf.tf_status = CST_IRQMASK | CST_IEp | CST_KUp;
+	tf.tf_epc = entry;
+	tf.tf_a0 = (vaddr_t)arg;
+	tf.tf_sp = stack;
+
+	mips_usermode(&tf);
+}
@@ -36,7 +36,9 @@
 #include <thread.h>
 #include <current.h>
 #include <copyinout.h>
+#include <proc.h>
 #include <syscall.h>
+#include <trace.h>
 
 
 /*
@@ -89,6 +91,7 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	TRACE(TRC_SYSCALL, TRE_SYSCALL, callno, curproc->p_pid);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -113,6 +116,15 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -120,12 +132,25 @@ syscall(struct trapframe *tf)
 		err = sys_fork(tf, &retval);
 		break;
 
+	    case SYS_vfork:
+		err = sys_vfork(tf, &retval);
+		break;
+
 	    case SYS_execv:
 		err = sys_execv(
 			(userptr_t)tf->tf_a0,
 			(userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_spawn:
+		err = sys_spawn(
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			(userptr_t)tf->tf_a2,
+			tf->tf_a3,
+			&retval);
+		break;
+
 	    case SYS__exit:
 		sys__exit(tf->tf_a0);
 		panic("Returning from exit\n");
@@ -142,6 +167,31 @@ syscall(struct trapframe *tf)
 		err = sys_getpid(&retval);
 		break;
 
+	    /* thread calls */
+
+	    case SYS___threadfork:
+		err = sys___threadfork(
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			&retval);
+		break;
+
+	    case SYS_threadexit:
+		sys_threadexit(tf->tf_a0);
+		panic("Returning from threadexit\n");
+
+	    case SYS_threadjoin:
+		err = sys_threadjoin(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
 
 	    /* file calls */
 
@@ -269,6 +319,7 @@ syscall(struct trapframe *tf)
 		break;
 	}
 
+	TRACE(TRC_SYSCALL, TRE_SYSRET, callno, err);
 
 	if (err) {
 		/*
@@ -38,6 +38,7 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <trace.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
@@ -146,6 +147,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	faultaddress &= PAGE_FRAME;
 
 	DEBUG(DB_VM, "dumbvm: fault: 0x%x\n", faultaddress);
+	TRACE(TRC_VM, TRE_VMFAULT, faultaddress, faulttype);
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
@@ -383,6 +385,22 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+/* dumbvm has room for only one stack, so no user threads. */
+vaddr_t
+as_threadstack(unsigned slot)
+{
+	(void)slot;
+	return USERSTACK;
+}
+
+int
+as_define_threadstack(struct addrspace *as, unsigned slot)
+{
+	(void)as;
+	(void)slot;
+	return ENOSYS;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
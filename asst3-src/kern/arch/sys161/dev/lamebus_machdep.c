@@ -76,6 +76,18 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Stretch the timer interval for tickless idle. Writing c0_compare
+ * restarts the count, so this replaces whatever was programmed
+ * before; the interrupt handler below puts it back to one period.
+ */
+void
+mainbus_settimer(unsigned ticks)
+{
+	KASSERT(ticks > 0 && ticks <= MAINBUS_TIMER_MAXTICKS);
+	mips_timer_set((CPU_FREQUENCY / HZ) * ticks);
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -304,6 +316,10 @@ mainbus_interrupt(struct trapframe *tf)
 	KASSERT(curthread->t_curspl > 0);
 
 	cause = tf->tf_cause;
+
+	/* Restart hardclock if we stopped it to idle. */
+	hardclock_idle_exit((cause & MIPS_TIMER_BIT) != 0);
+
 	if (cause & LAMEBUS_IRQ_BIT) {
 		lamebus_interrupt(lamebus);
 		seen = true;
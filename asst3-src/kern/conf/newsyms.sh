@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# newsyms.sh - emit ksyms.c, the kernel's symbol table, in the current
+#              directory (a build directory).
+#              Reads the output of "nm -n" on a linked kernel from
+#              standard input; given no input, emits an empty table.
+#
+# Usage: nm -n kernel | newsyms.sh
+#
+# Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+#	The President and Fellows of Harvard College.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+# 3. Neither the name of the University nor the names of its contributors
+#    may be used to endorse or promote products derived from this software
+#    without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+
+if [ ! -f autoconf.c ]; then
+    #
+    # If there's no file autoconf.c, we are in the wrong place.
+    #
+    echo "$0: Not in a kernel build directory"
+    exit 1
+fi
+
+#
+# Write ksyms.c. Only text symbols are kept; nm -n has already sorted
+# them by address, which is what ksym_lookup needs.
+#
+
+echo '/* This file is automatically generated. Edits will be lost.*/' > ksyms.c
+echo '#include <types.h>' >> ksyms.c
+echo '#include <ksyms.h>' >> ksyms.c
+echo 'const struct ksym ksyms[] = {' >> ksyms.c
+awk '
+    $2 == "T" || $2 == "t" {
+	printf "\t{ 0x%s, \"%s\" },\n", $1, $3;
+	n++;
+    }
+    END {
+	printf "\t{ 0, NULL }\n};\n";
+	printf "const unsigned ksyms_num = %d;\n", n;
+    }
+' >> ksyms.c
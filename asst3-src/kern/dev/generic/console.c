@@ -157,6 +157,9 @@ getch_intr(struct con_softc *cs)
  * tidier way to implement this check (that avoids wasting a slot,
  * too) would be with a second semaphore used with a nonblocking P,
  * but we don't have that in OS/161.
+ *
+ * Waking up the reader is left to con_inputwork, which runs after
+ * the interrupt handler has finished.
  */
 void
 con_input(void *vcs, int ch)
@@ -173,7 +176,32 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars[cs->cs_gotchars_head] = ch;
 	cs->cs_gotchars_head = nexthead;
 
-	V(cs->cs_rsem);
+	spinlock_acquire(&cs->cs_inputlock);
+	cs->cs_gotchars_new++;
+	spinlock_release(&cs->cs_inputlock);
+
+	workq_schedule(&cs->cs_inputwork);
+}
+
+/*
+ * Deferred part of con_input: wake up readers, once per character
+ * that has come in since the last time we ran.
+ */
+static
+void
+con_inputwork(void *vcs)
+{
+	struct con_softc *cs = vcs;
+	unsigned n;
+
+	spinlock_acquire(&cs->cs_inputlock);
+	n = cs->cs_gotchars_new;
+	cs->cs_gotchars_new = 0;
+	spinlock_release(&cs->cs_inputlock);
+
+	while (n-- > 0) {
+		V(cs->cs_rsem);
+	}
 }
 
 /*
@@ -386,6 +414,9 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	cs->cs_gotchars_new = 0;
+	spinlock_init(&cs->cs_inputlock);
+	workitem_init(&cs->cs_inputwork, con_inputwork, cs);
 
 	the_console = cs;
 	con_userlock_read = rlk;
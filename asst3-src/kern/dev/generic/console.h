@@ -37,6 +37,9 @@
  * device, and are to be initialized by the attach routine.
  */
 
+#include <spinlock.h>
+#include <workq.h>
+
 #define CONSOLE_INPUT_BUFFER_SIZE 32
 
 struct con_softc {
@@ -51,6 +54,9 @@ struct con_softc {
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+	unsigned cs_gotchars_new;	/* chars not yet V'd on cs_rsem */
+	struct spinlock cs_inputlock;	/* protects cs_gotchars_new */
+	struct workitem cs_inputwork;	/* deferred V of cs_rsem */
 };
 
 /*
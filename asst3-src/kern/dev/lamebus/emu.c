@@ -49,6 +49,7 @@
 #include <uio.h>
 #include <membar.h>
 #include <synch.h>
+#include <workq.h>
 #include <lamebus/emu.h>
 #include <platform/bus.h>
 #include <vfs.h>
@@ -129,6 +130,18 @@ emu_irq(void *dev)
 	sc->e_result = emu_rreg(sc, REG_RESULT);
 	emu_wreg(sc, REG_RESULT, 0);
 
+	workq_schedule(&sc->e_work);
+}
+
+/*
+ * Deferred part of the interrupt: wake up the waiting thread.
+ */
+static
+void
+emu_donework(void *dev)
+{
+	struct emu_softc *sc = dev;
+
 	V(sc->e_sem);
 }
 
@@ -1349,6 +1362,7 @@ config_emu(struct emu_softc *sc, int emuno)
 		sc->e_lock = NULL;
 		return ENOMEM;
 	}
+	workitem_init(&sc->e_work, emu_donework, sc);
 	sc->e_iobuf = bus_map_area(sc->e_busdata, sc->e_buspos, EMU_BUFFER);
 
 	snprintf(name, sizeof(name), "emu%d", emuno);
@@ -37,6 +37,8 @@
 #include <uio.h>
 #include <membar.h>
 #include <synch.h>
+#include <workq.h>
+#include <trace.h>
 #include <platform/bus.h>
 #include <vfs.h>
 #include <lamebus/lhd.h>
@@ -104,6 +106,19 @@ void
 lhd_iodone(struct lhd_softc *lh, int err)
 {
 	lh->lh_result = err;
+	workq_schedule(&lh->lh_work);
+}
+
+/*
+ * Deferred part of I/O completion: wake up the waiting thread. This
+ * runs after the interrupt handler, with interrupts on.
+ */
+static
+void
+lhd_donework(void *vlh)
+{
+	struct lhd_softc *lh = vlh;
+
 	V(lh->lh_done);
 }
 
@@ -231,6 +246,8 @@ lhd_io(struct device *d, struct uio *uio)
 			}
 		}
 
+		TRACE(TRC_DISK, TRE_DISKIO, sector+i, uio->uio_rw);
+
 		/* Tell it what sector we want... */
 		lhd_wreg(lh, LHD_REG_SECT, sector+i);
 
@@ -242,6 +259,7 @@ lhd_io(struct device *d, struct uio *uio)
 
 		/* Get the result value saved by the interrupt handler. */
 		result = lh->lh_result;
+		TRACE(TRC_DISK, TRE_DISKDONE, sector+i, result);
 
 		/*
 		 * Are we reading? If so, and if we succeeded,
@@ -295,6 +313,7 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 		lh->lh_clear = NULL;
 		return ENOMEM;
 	}
+	workitem_init(&lh->lh_work, lhd_donework, lh);
 
 	/* Set up the VFS device structure. */
 	lh->lh_dev.d_ops = &lhd_devops;
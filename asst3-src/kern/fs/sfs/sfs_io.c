@@ -39,6 +39,7 @@
 #include <vfs.h>
 #include <device.h>
 #include <sfs.h>
+#include <trace.h>
 #include "sfsprivate.h"
 
 ////////////////////////////////////////////////////////////
@@ -67,6 +68,8 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 	DEBUG(DB_SFS, "sfs: %s %llu\n",
 	      uio->uio_rw == UIO_READ ? "read" : "write",
 	      uio->uio_offset / SFS_BLOCKSIZE);
+	TRACE(TRC_DISK, TRE_SFSIO, uio->uio_offset / SFS_BLOCKSIZE,
+	      uio->uio_rw);
 
  retry:
 	result = DEVOP_IO(sfs->sfs_device, uio);
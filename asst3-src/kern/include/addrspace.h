@@ -119,6 +119,12 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_define_threadstack - set up the stack region for user thread
+ *                stack slot SLOT (1 and up; slot 0 is the main stack).
+ *
+ *    as_threadstack - return the initial stack pointer for stack slot
+ *                SLOT.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -137,6 +143,8 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_threadstack(struct addrspace *as, unsigned slot);
+vaddr_t           as_threadstack(unsigned slot);
 
 
 /*
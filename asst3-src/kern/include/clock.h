@@ -48,6 +48,17 @@
 void hardclock_bootstrap(void);
 void hardclock(void);
 
+/*
+ * Tickless idle. The idle loop calls hardclock_idle_enter just before
+ * idling; if no timeout is due soon, it stops hardclock on this cpu
+ * until one is. hardclock_idle_exit restarts it and catches up on the
+ * hardclocks that were skipped. It must be called, with interrupts
+ * off, on any interrupt before the interrupt is dispatched (TIMER is
+ * true if the timer itself went off) as well as after idling.
+ */
+void hardclock_idle_enter(void);
+void hardclock_idle_exit(bool timer);
+
 /*
  * timerclock() is called on one CPU once a second to allow simple
  * timed operations. (This is a fairly simpleminded interface.)
@@ -31,6 +31,7 @@
 #define _CPU_H_
 
 
+#include <kern/time.h>
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
@@ -46,6 +47,24 @@
  * a pointer with a fixed address and a per-cpu mapping in the MMU.
  */
 
+/*
+ * Per-cpu accounting, printed by the "stats" menu command. Ticks are
+ * hardclocks, including ones skipped by tickless idle. A migration
+ * is counted by the cpu a thread moves to. The run queue length is
+ * sampled every hardclock.
+ */
+struct cpustats {
+	unsigned cs_busyticks;		/* Ticks with a thread running */
+	unsigned cs_idleticks;		/* Ticks spent idle */
+	unsigned cs_nvcsw;		/* Voluntary context switches */
+	unsigned cs_nivcsw;		/* Involuntary context switches */
+	unsigned cs_migrations;		/* Threads arriving from elsewhere */
+	unsigned cs_ipisent;		/* Interprocessor interrupts sent */
+	unsigned cs_ipirecv;		/* ... and received */
+	uint64_t cs_rqsum;		/* Sum of run queue length samples */
+	unsigned cs_rqsamples;		/* Number of samples */
+};
+
 struct cpu {
 	/*
 	 * Fixed after allocation.
@@ -58,9 +77,26 @@ struct cpu {
 	 * Accessed only by this cpu.
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
+	struct thread *c_moving;	/* Thread leaving for another cpu */
+	struct thread *c_idlethread;	/* Idles while c_moving leaves */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadpool;	/* Recycled threads with stacks */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	unsigned c_idleticks;		/* Hardclocks skipped while idle */
+	struct timespec c_idlestart;	/* When hardclock was stopped */
+	struct workitem *c_workq;	/* Deferred work (see workq.c) */
+	struct workitem **c_workq_tail;
+	bool c_intr_user;		/* Interrupt came from user mode */
+	vaddr_t c_intr_pc;		/* ... and from this address */
+	struct cpustats c_stats;	/* Accounting; see above */
+	struct tracebuf *c_trace;	/* Trace records (see trace.c) */
+	struct profbuf *c_prof;		/* Profiler counts (see prof.c) */
+
+	/*
+	 * Accessed by other cpus. Protected inside rcu.c.
+	 */
+	unsigned c_rcu_gp;		/* Last grace period reported */
 
 	/*
 	 * Accessed by other cpus.
@@ -88,10 +124,21 @@ struct cpu {
 	unsigned c_numshootdown;
 	struct spinlock c_ipi_lock;
 
+	/*
+	 * Accessed by other cpus (to cancel timeouts). Protected
+	 * inside timeout.c.
+	 */
+	struct timerwheel *c_timers;	/* Pending timeouts */
+
 	/*
 	 * Accessed by other cpus. Protected inside hangman.c.
 	 */
 	HANGMAN_ACTOR(c_hangman);
+
+	/*
+	 * Accessed only by this cpu.
+	 */
+	LOCKSTAT_ACTOR(c_lockstat);
 };
 
 /*
@@ -102,12 +149,18 @@ struct cpu {
  *
  * cpu_create calls cpu_machdep_init.
  *
+ * cpu_count and cpu_get (by software number) are for code that needs
+ * to look at every cpu. The set doesn't change once the secondary
+ * cpus have been found.
+ *
  * cpu_start_secondary is the platform-dependent assembly language
  * entry point for new CPUs; it can be found in start.S. It calls
  * cpu_hatch after having claimed the startup stack and thread created
  * for the cpu.
  */
 struct cpu *cpu_create(unsigned hardware_number);
+unsigned cpu_count(void);
+struct cpu *cpu_get(unsigned num);
 void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
@@ -48,14 +48,17 @@
  * or even to make it dynamic with the limit being user-settable. (See
  * setrlimit(2) on a Unix machine.)
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * On fork the table is copied, but threads of one process share it.
+ * Lookups are far more common than changes, so the table is protected
+ * by a reader-writer lock: get and copy take it for reading, place
+ * and placeat for writing. (Destroy assumes nobody else is using the
+ * table any more.)
+ * The lock is only held for the table access itself; get takes its
+ * own reference to the openfile, which put drops, so one thread can
+ * close() a file another thread is in the middle of read()ing.
  */
 struct filetable {
+	struct rwlock *ft_rwlock;
 	struct openfile *ft_openfiles[OPEN_MAX];
 };
 
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KERN_SPAWN_H_
+#define _KERN_SPAWN_H_
+
+/*
+ * Definitions for spawn().
+ *
+ * spawn starts a program in a new process without copying the
+ * caller: the new process gets a copy of the caller's file table,
+ * edited by a list of file actions applied in order, and the
+ * program is loaded straight into a fresh address space.
+ */
+
+/* File actions. */
+#define SPAWN_OPEN	1	/* open sa_path with flags sa_arg on sa_fd */
+#define SPAWN_DUP2	2	/* dup2(sa_arg, sa_fd) */
+#define SPAWN_CLOSE	3	/* close(sa_fd) */
+
+/* Most file actions one call may have. */
+#define SPAWN_MAXACTIONS	16
+
+struct spawn_action {
+	int sa_op;		/* SPAWN_* */
+	int sa_fd;		/* File descriptor in the new process */
+	int sa_arg;		/* Open flags or source fd */
+	const char *sa_path;	/* Path, for SPAWN_OPEN */
+};
+
+#endif /* _KERN_SPAWN_H_ */
@@ -86,7 +86,7 @@
 //#define SYS_sigaltstack 33
 //                              (resource tracking and usage)
 //#define SYS_wait4      34
-//#define SYS_getrusage  35
+#define SYS_getrusage  35
 //                              (resource limits)
 //#define SYS_getrlimit  36
 //#define SYS_setrlimit  37
@@ -197,6 +197,16 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Threads (OS/161-specific) --
+#define SYS___threadfork 121
+#define SYS_threadexit   122
+#define SYS_threadjoin   123
+#define SYS_futex_wait   124
+#define SYS_futex_wake   125
+
+//                              -- Process creation (OS/161-specific) --
+#define SYS_spawn        126
+
 /*CALLEND*/
 
 
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+/*
+ * Lock contention statistics. Enable with "options lockstat" in the
+ * kernel config.
+ *
+ * This uses the same hook points as hangman: an actor (cpu or thread)
+ * waits for a lockable, acquires it, and later releases it. For each
+ * lock class we count acquisitions and contended acquisitions, and
+ * total and maximum wait and hold times. Sleep locks and rwlocks are
+ * grouped by name; spinlocks have no name and are grouped by the
+ * address spinlock_acquire was called from.
+ *
+ * The hooks must be called with interrupts off, which the lock code
+ * does anyway.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+struct lockstat_class;
+
+struct lockstat_actor {
+	uint64_t a_waitstart;			/* ns, 0 if not waiting */
+};
+
+struct lockstat_lockable {
+	const char *l_name;			/* NULL for spinlocks */
+	struct lockstat_class *l_class;		/* cached class, if named */
+	struct lockstat_class *l_holdclass;	/* class to charge */
+	uint64_t l_holdstart;			/* ns */
+};
+
+void lockstat_wait(struct lockstat_actor *a);
+void lockstat_acquire(struct lockstat_actor *a, struct lockstat_lockable *l,
+		      bool contended, const void *caller);
+void lockstat_release(struct lockstat_lockable *l);
+
+void lockstat_bootstrap(void);
+void lockstat_dump(void);
+void lockstat_reset(void);
+
+#define LOCKSTAT_ACTOR(sym)	struct lockstat_actor sym
+#define LOCKSTAT_LOCKABLE(sym)	struct lockstat_lockable sym
+
+#define LOCKSTAT_ACTORINIT(a)	    ((a)->a_waitstart = 0)
+#define LOCKSTAT_LOCKABLEINIT(l, n) \
+	((l)->l_name = (n), (l)->l_class = NULL, (l)->l_holdclass = NULL)
+
+#define LOCKSTAT_LOCKABLE_INITIALIZER	{ NULL, NULL, NULL, 0 }
+
+#define LOCKSTAT_WAIT(a)	lockstat_wait(a)
+#define LOCKSTAT_ACQUIRE(a, l, contended, caller) \
+	lockstat_acquire(a, l, contended, caller)
+#define LOCKSTAT_RELEASE(l)	lockstat_release(l)
+
+#else
+
+#define LOCKSTAT_ACTOR(sym)
+#define LOCKSTAT_LOCKABLE(sym)
+
+#define LOCKSTAT_ACTORINIT(a)
+#define LOCKSTAT_LOCKABLEINIT(l, n)
+
+#define LOCKSTAT_LOCKABLE_INITIALIZER
+
+#define LOCKSTAT_WAIT(a)
+#define LOCKSTAT_ACQUIRE(a, l, contended, caller)	((void)(contended))
+#define LOCKSTAT_RELEASE(l)
+
+#define lockstat_bootstrap()
+
+#endif
+
+#endif /* LOCKSTAT_H */
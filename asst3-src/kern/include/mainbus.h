@@ -52,6 +52,14 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Make the next hardclock on the current cpu come TICKS hardclock
+ * periods from now, rather than one; after it, they go back to every
+ * period. TICKS may be at most MAINBUS_TIMER_MAXTICKS.
+ */
+#define MAINBUS_TIMER_MAXTICKS	HZ
+void mainbus_settimer(unsigned ticks);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
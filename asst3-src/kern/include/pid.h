@@ -35,6 +35,8 @@
 #define _PID_H_
 
 
+struct threadstats;
+
 #define INVALID_PID	0	/* nothing has this pid */
 #define KERNEL_PID	1	/* kernel proc has this pid */
 
@@ -58,15 +60,27 @@ void pid_unalloc(pid_t targetpid);
  */
 void pid_disown(pid_t targetpid);
 
+/*
+ * Hide a child that's still being set up from pid_wait; if it exits
+ * while hidden its status is discarded. The child makes itself
+ * visible with pid_unhide once it's going to run.
+ */
+void pid_hide(pid_t targetpid);
+void pid_unhide(void);
+
 /*
  * Set the exit status of the current thread to status.  Wakes up any threads
  * waiting to read this status, and decrefs the current thread's pid.
+ * STATS is the process's final accounting, which the parent collects
+ * along with the status.
  */
-void pid_setexitstatus(int status);
+void pid_setexitstatus(int status, const struct threadstats *stats);
 
 /*
  * Causes the current thread to wait for the thread with pid PID to
- * exit, returning the exit status when it does.
+ * exit, returning the exit status when it does. PID may be WAIT_ANY
+ * to wait for whichever child exits first; RETPID gets the pid
+ * collected.
  */
 int pid_wait(pid_t targetpid, int *status, int flags, pid_t *retpid);
 
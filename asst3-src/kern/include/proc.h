@@ -40,13 +40,24 @@
 #include <thread.h> /* required for struct threadarray */
 
 struct addrspace;
+struct semaphore;
 struct vnode;
 
+/*
+ * User threads per process. A thread id is also the thread's stack
+ * slot (see as_threadstack); thread 0 runs on the main stack.
+ */
+#define PROC_MAXTHREADS	32
+#define PROC_TIDBIT(tid)	((uint32_t)1 << (tid))
+
 /*
  * Process structure.
  *
- * Note that unless you implement multithreaded processes, p_threads
- * will only contain one thread for all processes other than kproc.
+ * User processes may have several threads (see threadfork), which
+ * share everything here. A thread id stays in use after the thread
+ * exits until someone collects its status with threadjoin; the
+ * process itself exits when its last thread does, with the status
+ * given to the first _exit if any.
  *
  * Note: you can't protect p_threads with a spinlock because it needs
  * to be able to call kmalloc.
@@ -55,11 +66,25 @@ struct proc {
 	char *p_name;			/* Name of this process */
 	struct lock *p_threadslock;	/* Lock for p_threads */
 	struct threadarray p_threads;	/* Threads in this process */
+
+	/* User threads; protected by p_threadslock */
+	struct cv *p_threadcv;		/* A thread exited or detached */
+	unsigned p_nuthreads;		/* User threads still running */
+	uint32_t p_tidsused;		/* Ids running or not yet joined */
+	uint32_t p_tidsexited;		/* Ids exited but not yet joined */
+	uint32_t p_stacksdefined;	/* Stack slots set up in p_addrspace */
+	int p_tidstatus[PROC_MAXTHREADS]; /* Status of exited threads */
+	bool p_exiting;			/* _exit has been called */
+	int p_exitstatus;		/* Status from _exit */
+	struct threadstats p_stats;	/* Usage of threads that have left */
+	struct threadstats p_childstats; /* Usage of collected children */
+
 	struct spinlock p_lock;		/* Lock for rest of this structure */
 	pid_t p_pid;			/* Process ID */
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
+	struct semaphore *p_vforkdone;	/* Set while p_addrspace is borrowed */
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
@@ -80,6 +105,16 @@ int proc_create_runprogram(const char *name, struct proc **ret);
 /* Create a fresh process for use by fork() */
 int proc_fork(struct proc **ret);
 
+/*
+ * Create a process for use by vfork(), which borrows the current
+ * process's address space instead of copying it. DONE is V'd when the
+ * new process gives it back, by calling proc_vforkdone (on exec) or
+ * exiting. proc_vforkdone returns false if the address space wasn't
+ * borrowed.
+ */
+int proc_vfork(struct semaphore *done, struct proc **ret);
+bool proc_vforkdone(void);
+
 /* Undo proc_fork if nothing's run in the new process yet. */
 void proc_unfork(struct proc *proc);
 
@@ -95,12 +130,40 @@ void proc_destroy(struct proc *proc);
  */
 void proc_exit(int status);
 
+/*
+ * User thread support.
+ *
+ * proc_newthread reserves a thread id in the current process and
+ * makes sure its stack exists; proc_unnewthread undoes it if the
+ * thread can't be started. proc_threadexit makes the current thread
+ * exit with STATUS for threadjoin, taking the process with it if it
+ * was the last. proc_threadjoin waits for thread TID to exit and
+ * collects its status. proc_execreset is for a successful execv,
+ * which only a single-threaded process may do (see
+ * proc_singlethreaded), to put the thread bookkeeping back to that
+ * of a fresh process.
+ */
+int proc_newthread(unsigned *tid, vaddr_t *stackptr);
+void proc_unnewthread(unsigned tid);
+__DEAD void proc_threadexit(int status);
+int proc_threadjoin(unsigned tid, int *status);
+bool proc_singlethreaded(void);
+void proc_execreset(void);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/*
+ * Accounting. proc_getstats returns the process's own usage, or with
+ * CHILDREN that of the children it has collected with waitpid, which
+ * is charged to it by proc_addchildstats.
+ */
+void proc_getstats(struct proc *proc, bool children, struct threadstats *ret);
+void proc_addchildstats(struct proc *proc, const struct threadstats *stats);
+
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
 
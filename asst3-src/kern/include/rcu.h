@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _RCU_H_
+#define _RCU_H_
+
+/*
+ * Read-copy-update, quiescent-state based.
+ *
+ * RCU lets readers look at a shared structure without taking any
+ * lock. Writers still serialize among themselves with an ordinary
+ * lock; when they unlink something that readers might be looking
+ * at, they wait (synchronize_rcu) or arrange a callback (call_rcu)
+ * before freeing it, until every cpu has passed through a quiescent
+ * state and so can't still be holding a pointer to it.
+ *
+ * A read section runs between rcu_read_lock and rcu_read_unlock. It
+ * turns interrupts off, so it can't be preempted, and it must not
+ * sleep. This means a context switch, or taking an interrupt, is a
+ * quiescent state for the cpu it happens on; and an idle cpu is
+ * quiescent all the time.
+ *
+ * Read sections nest. They should be short: a lookup, not a walk.
+ */
+
+#include <membar.h>
+
+struct rcu_head {
+	struct rcu_head *rh_next;	/* Link in callback list */
+	void (*rh_func)(void *);	/* Callback */
+	void *rh_data;			/* Argument for callback */
+};
+
+/*
+ * Publish a pointer for readers: make sure the initialization of the
+ * structure it points to is visible before the pointer is.
+ */
+#define rcu_assign_pointer(p, v) \
+	(membar_store_store(), (p) = (v))
+
+/*
+ * rcu_read_lock - begin a read section.
+ * rcu_read_unlock - end it.
+ * call_rcu - arrange for FUNC(DATA) to be called, using RH for
+ *           bookkeeping, once all current read sections are over.
+ *           Callbacks run from the deferred work queue (see workq.h)
+ *           and must not sleep.
+ * synchronize_rcu - wait until all current read sections are over.
+ */
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void call_rcu(struct rcu_head *rh, void (*func)(void *), void *data);
+void synchronize_rcu(void);
+
+/*
+ * Setup (from main), and the hook that records a quiescent state for
+ * the current cpu, called from thread_switch and hardclock.
+ */
+void rcu_bootstrap(void);
+void rcu_quiescent(void);
+
+
+#endif /* _RCU_H_ */
@@ -37,6 +37,7 @@
 
 #include <cdefs.h>
 #include <hangman.h>
+#include <lockstat.h>
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -51,24 +52,35 @@
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * Spinlocks are ticket locks: each cpu wanting the lock takes the
+ * next ticket and waits until splk_serving reaches it, so the lock is
+ * handed out in arrival order and waiters only read the shared word
+ * until their turn comes.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
-	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
+	volatile spinlock_data_t splk_next; /* Next ticket to hand out. */
+	volatile spinlock_data_t splk_serving; /* Ticket holding the lock. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
+	LOCKSTAT_LOCKABLE(splk_lockstat);   /* Contention stats hook. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#ifdef OPT_HANGMAN
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
-				  HANGMAN_LOCKABLE_INITIALIZER }
+#if OPT_HANGMAN
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, \
+				  SPINLOCK_DATA_INITIALIZER, NULL, \
+				  HANGMAN_LOCKABLE_INITIALIZER, \
+				  LOCKSTAT_LOCKABLE_INITIALIZER }
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, \
+				  SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_LOCKABLE_INITIALIZER }
 #endif
 
 /*
@@ -71,13 +71,22 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * Waiters spin while the holder is running on another cpu, and only
+ * sleep on lk_wchan once it isn't. lk_waiters counts the sleepers.
+ * When the holder releases the lock with sleepers present, it wakes
+ * exactly one and sets lk_handoff, which reserves the lock for that
+ * thread so that spinners and newcomers can't take it first.
  */
 struct lock {
         char *lk_name;
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
+        LOCKSTAT_LOCKABLE(lk_lockstat); /* Contention stats hook. */
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
+        unsigned lk_waiters;            /* Threads asleep on lk_wchan */
+        volatile bool lk_handoff;       /* Reserved for a woken waiter */
 };
 
 struct lock *lock_create(const char *name);
@@ -115,8 +124,9 @@ bool lock_do_i_hold(struct lock *);
 
 struct cv {
         char *cv_name;
-        struct wchan *cv_wchan;
-        struct spinlock cv_wchanlock;
+        struct wchan *cv_wchan;         /* Protected by cv_lock->lk_lock */
+        struct lock *cv_lock;           /* Lock the waiters are using */
+        unsigned cv_waiters;            /* Threads asleep on cv_wchan */
 };
 
 struct cv *cv_create(const char *name);
@@ -130,8 +140,9 @@ void cv_destroy(struct cv *);
  *    cv_broadcast - Wake up all threads sleeping on this CV.
  *
  * For all three operations, the current thread must hold the lock passed
- * in. Note that under normal circumstances the same lock should be used
- * on all operations with any particular CV.
+ * in. All threads waiting on a CV at the same time must use the same
+ * lock, since the waiters are kept under that lock's spinlock and are
+ * moved onto its wait queue when signalled.
  *
  * These operations must be atomic. You get to write them.
  */
@@ -140,4 +151,56 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, newly arriving
+ * readers wait behind it. To keep readers from starving, a writer
+ * that releases the lock while readers are waiting admits all of
+ * those readers (rwl_admit counts the ones that haven't run yet)
+ * before any other writer may go.
+ *
+ * rwl_readgen distinguishes readers that were waiting at that
+ * release, and thus admitted, from ones that arrived afterwards.
+ */
+struct rwlock {
+        char *rwl_name;
+        HANGMAN_LOCKABLE(rwl_hangman);  /* Deadlock detector hook. */
+        LOCKSTAT_LOCKABLE(rwl_lockstat); /* Contention stats hook. */
+        struct wchan *rwl_rwchan;       /* Readers wait here */
+        struct wchan *rwl_wwchan;       /* Writers wait here */
+        struct spinlock rwl_lock;
+        unsigned rwl_readers;           /* Readers holding the lock */
+        unsigned rwl_rwaiting;          /* Readers asleep */
+        unsigned rwl_wwaiting;          /* Writers asleep */
+        unsigned rwl_admit;             /* Admitted readers yet to run */
+        unsigned rwl_readgen;           /* Bumped when readers admitted */
+        struct thread *rwl_writer;      /* Writer holding the lock */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading, shared with
+ *                           other readers.
+ *    rwlock_release_read  - Drop a read hold.
+ *    rwlock_acquire_write - Get the lock exclusively.
+ *    rwlock_release_write - Drop the exclusive hold.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock for writing. (There is no
+ *                           equivalent for readers, who aren't
+ *                           tracked individually.)
+ *
+ * The lock is not recursive, in either mode.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -51,9 +51,16 @@ void enter_forked_process(struct trapframe *tf);
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
 
+/* Enter user mode in a new user thread. Does not return. */
+__DEAD void enter_new_thread(userptr_t arg, vaddr_t stackptr,
+			     vaddr_t entrypoint);
+
 /* Setup function for exec. */
 void exec_bootstrap(void);
 
+/* Setup function for futexes. */
+void futex_bootstrap(void);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -64,12 +71,22 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
+int sys_getrusage(int who, userptr_t usage);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
+int sys_spawn(userptr_t prog, userptr_t args, userptr_t actions, int nactions,
+	      pid_t *retval);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
+int sys___threadfork(userptr_t start, userptr_t arg, int *retval);
+__DEAD void sys_threadexit(int status);
+int sys_threadjoin(int tid, userptr_t retstatus);
+int sys_futex_wait(userptr_t addr, int val);
+int sys_futex_wake(userptr_t addr, int n, int *retval);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
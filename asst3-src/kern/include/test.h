@@ -53,10 +53,22 @@ int threadlisttest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int rttest(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int locklattest(int, char **);
+int rwtest(int, char **);
+int spinlockbench(int, char **);
+
+/* scheduler and locking benchmarks */
+int ctxswbench(int, char **);
+int wakebench(int, char **);
+int xcpuwakebench(int, char **);
+int forkbench(int, char **);
+int lockbench(int, char **);
+int schedbench(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
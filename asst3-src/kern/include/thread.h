@@ -41,6 +41,7 @@
 #include <threadlist.h>
 
 struct cpu;
+struct lock;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -64,6 +65,22 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * Per-thread accounting. Times are in hardclock ticks, charged to
+ * whatever is running when the tick happens (so they are samples,
+ * not exact). Switches are voluntary when the thread sleeps or yields
+ * of its own accord and involuntary when it is preempted from an
+ * interrupt. Processes keep totals in the same form (see proc.h).
+ */
+struct threadstats {
+	unsigned ts_uticks;		/* Ticks running in user mode */
+	unsigned ts_sticks;		/* Ticks running in the kernel */
+	unsigned ts_waitticks;		/* Ticks runnable but not running */
+	unsigned ts_nsleeps;		/* Times slept on a wait channel */
+	unsigned ts_nvcsw;		/* Voluntary context switches */
+	unsigned ts_nivcsw;		/* Involuntary context switches */
+};
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -82,8 +99,61 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	bool t_intransit;		/* Off any run queue while migrating */
 	struct proc *t_proc;		/* Process thread belongs to */
+	unsigned t_tid;			/* User thread id within t_proc */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
+	LOCKSTAT_ACTOR(t_lockstat);	/* Contention stats hook */
+
+	/*
+	 * Scheduler fields. t_priority is the thread's multilevel
+	 * feedback queue level (0 is the highest priority); t_ticks
+	 * counts the hardclocks it has used of its quantum at that
+	 * level. Protected by the runqueue lock of t_cpu while the
+	 * thread is runnable.
+	 */
+	unsigned t_priority;		/* MLFQ level */
+	unsigned t_ticks;		/* Quantum used at this level */
+	int t_policy;			/* SCHED_OTHER, SCHED_FIFO, SCHED_RR */
+	unsigned t_rtprio;		/* Real-time priority */
+
+	/*
+	 * Priority inheritance. A thread holding locks that more
+	 * urgent threads are waiting for runs at the best level among
+	 * those waiters, t_inherit, until it has released all its
+	 * locks. t_inherit is written under the t_cpu runqueue lock;
+	 * t_waitlock (the lock the thread is blocked on, if any) is
+	 * protected by the priority inheritance lock in synch.c.
+	 * t_locksheld is only touched by the thread itself.
+	 */
+	unsigned t_inherit;		/* Inherited level, or NOINHERIT */
+	struct lock *t_waitlock;	/* Lock we're blocked on */
+	unsigned t_locksheld;		/* Number of locks held */
+
+	/*
+	 * Cpu placement. t_lastcpu and t_lastrun record where the
+	 * thread last ran and the value of that cpu's c_hardclocks
+	 * when it stopped, so we can guess whether its cache is still
+	 * warm. t_affinity has bit N set if the thread may run on cpu
+	 * number N.
+	 */
+	struct cpu *t_lastcpu;		/* Cpu thread last ran on */
+	unsigned t_lastrun;		/* c_hardclocks when it stopped */
+	uint32_t t_affinity;		/* Cpus thread may run on */
+
+	/*
+	 * Accounting. t_readystamp is the c_hardclocks value of the
+	 * cpu the thread was made runnable on, for ts_waitticks.
+	 */
+	struct threadstats t_stats;	/* Counters */
+	unsigned t_readystamp;		/* When it last became runnable */
+
+	/*
+	 * RCU read sections (see rcu.c). Only touched by the thread
+	 * itself.
+	 */
+	unsigned t_rcu_depth;		/* Nesting of rcu_read_lock */
+	int t_rcu_spl;			/* spl to go back to afterwards */
 
 	/*
 	 * Interrupt state fields.
@@ -145,6 +215,55 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Restrict the current thread to the cpus whose numbers are set in
+ * MASK (bit N for cpu N); THREAD_AFFINITY_ALL allows all of them.
+ * Threads forked afterwards inherit the mask. Returns EINVAL if the
+ * mask names no cpu that exists.
+ *
+ * The mask is applied whenever the thread is placed on a run queue:
+ * on wakeup, on migration and stealing, and when it yields. A thread
+ * running on a cpu outside its new mask moves at the next of those
+ * points at which there is something else for that cpu to run.
+ */
+#define THREAD_AFFINITY_ALL	((uint32_t)0xffffffff)
+int thread_setaffinity(uint32_t mask);
+
+/*
+ * Scheduling classes.
+ *
+ * SCHED_OTHER threads, the default, are scheduled by the multilevel
+ * feedback queue. SCHED_FIFO and SCHED_RR threads have a fixed
+ * real-time priority from 0 (most urgent) to THREAD_RT_LEVELS-1, and
+ * always run ahead of SCHED_OTHER threads. A SCHED_FIFO thread runs
+ * until it blocks or yields or something more urgent is ready; a
+ * SCHED_RR thread also gives way to others at its priority after a
+ * fixed quantum.
+ *
+ * thread_setsched puts the current thread in a class; RTPRIO is
+ * ignored for SCHED_OTHER. Threads forked afterwards inherit it.
+ * Returns EINVAL for an unknown policy or priority out of range.
+ */
+#define SCHED_OTHER	0
+#define SCHED_FIFO	1
+#define SCHED_RR	2
+#define THREAD_RT_LEVELS	8
+int thread_setsched(int policy, unsigned rtprio);
+
+/*
+ * Priority inheritance hooks for the lock code.
+ *
+ * thread_priority returns the level T is scheduled at: levels below
+ * THREAD_RT_LEVELS are real-time priorities, and SCHED_OTHER threads
+ * are at THREAD_RT_LEVELS plus their MLFQ level. If T has inherited a
+ * more urgent (lower) level through a lock, that is returned instead.
+ * thread_inherit sets the level T inherits, or drops it if PRI is
+ * THREAD_NOINHERIT, requeueing T if it is waiting to run.
+ */
+#define THREAD_NOINHERIT	((unsigned)-1)
+unsigned thread_priority(const struct thread *t);
+void thread_inherit(struct thread *t, unsigned pri);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -158,6 +277,13 @@ __DEAD void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Charge the current thread for one timer tick, and preempt it if its
+ * quantum has run out or a higher-priority thread is ready to run.
+ * Called from the timer interrupt.
+ */
+void thread_tick(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
@@ -169,5 +295,12 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * Accounting: add FROM's counters into TO, and print the per-cpu
+ * counters (for the "stats" menu command).
+ */
+void threadstats_add(struct threadstats *to, const struct threadstats *from);
+void thread_printstats(void);
+
 
 #endif /* _THREAD_H_ */
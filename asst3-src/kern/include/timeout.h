@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TIMEOUT_H_
+#define _TIMEOUT_H_
+
+/*
+ * Timeouts: callbacks run after a given number of hardclock ticks.
+ *
+ * Each cpu keeps its pending timeouts in a hierarchical timer wheel
+ * (see timeout.c) advanced by hardclock(), so arming and cancelling
+ * take constant time. A timeout fires on the cpu that armed it, in
+ * interrupt context: the callback must not sleep.
+ *
+ * The caller provides the struct timeout, so arming one never
+ * allocates memory and can be done from interrupt handlers.
+ */
+
+struct cpu;
+
+struct timeout {
+	struct timeout *to_next;	/* Link in wheel slot */
+	struct timeout **to_pprev;	/* Back link; NULL if not pending */
+	unsigned to_expire;		/* c_hardclocks value to fire at */
+	struct cpu *to_cpu;		/* Cpu whose wheel we're on */
+	void (*to_func)(void *);	/* Callback */
+	void *to_data;			/* Argument for callback */
+};
+
+/*
+ * timeout - arrange for FUNC(DATA) to be called TICKS hardclocks from
+ *           now on the current cpu, using TO (which must not already
+ *           be pending) for bookkeeping. TICKS of 0 is taken as 1.
+ * untimeout - cancel TO. Returns true if it was pending; false if it
+ *           had already fired (or was never armed). Does not wait for
+ *           a callback that is running on another cpu to finish.
+ * timeout_pending - return true if TO has been armed and not yet
+ *           fired or been cancelled.
+ */
+void timeout(struct timeout *to, unsigned ticks,
+	     void (*func)(void *), void *data);
+bool untimeout(struct timeout *to);
+bool timeout_pending(struct timeout *to);
+
+/*
+ * timeout_sleep - put the current thread to sleep for TICKS
+ *           hardclocks.
+ */
+void timeout_sleep(unsigned ticks);
+
+/*
+ * Setup (from hardclock_bootstrap and cpu_create), and the hook that
+ * advances the current cpu's wheel, called from hardclock.
+ */
+void timeout_bootstrap(void);
+struct timerwheel *timerwheel_create(void);
+void timeout_hardclock(void);
+
+/*
+ * For tickless idle: return the number of ticks, at most MAX, until
+ * the current cpu's wheel next has work to do.
+ */
+unsigned timeout_nextdue(unsigned max);
+
+
+#endif /* _TIMEOUT_H_ */
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Kernel event tracing. Enable with "options trace" in the kernel
+ * config.
+ *
+ * Tracepoints are compiled in at fixed places (the TRACE() calls)
+ * and grouped into categories, which are switched on and off at
+ * runtime with the "trace" menu command. A tracepoint whose category
+ * is off costs a load and a test. One that is on writes a fixed-size
+ * record, with a timestamp, into a ring buffer belonging to the
+ * current cpu. Only that cpu writes its buffer, so recording takes
+ * no locks, just interrupts off for the moment it takes; this means
+ * tracepoints can go anywhere, including inside the lock code.
+ * When a buffer fills, the oldest records are overwritten.
+ */
+
+#include "opt-trace.h"
+
+/* Categories */
+#define TRC_SCHED	0x01	/* Context switches */
+#define TRC_VM		0x02	/* VM faults */
+#define TRC_SYSCALL	0x04	/* System call entry and exit */
+#define TRC_DISK	0x08	/* Filesystem and disk I/O */
+#define TRC_LOCK	0x10	/* Sleep lock acquisition */
+#define TRC_ALL		0x1f
+
+/* Events; the meaning of the two arguments is noted for each. */
+#define TRE_SWITCH	0	/* thread_switch: next thread, old state */
+#define TRE_VMFAULT	1	/* vm_fault: address, fault type */
+#define TRE_SYSCALL	2	/* syscall entry: call number, pid */
+#define TRE_SYSRET	3	/* syscall exit: call number, error */
+#define TRE_SFSIO	4	/* sfs_rwblock: block, UIO_READ/UIO_WRITE */
+#define TRE_DISKIO	5	/* lhd_io start: sector, UIO_READ/WRITE */
+#define TRE_DISKDONE	6	/* lhd_io finish: sector, error */
+#define TRE_LOCK	7	/* lock_acquire: lock, whether it waited */
+#define TRE_NEVENTS	8
+
+/*
+ * One trace record; 24 bytes.
+ */
+struct tracerec {
+	uint32_t tr_sec;		/* Timestamp */
+	uint32_t tr_nsec;
+	const void *tr_thread;		/* curthread at the time */
+	uint32_t tr_event;		/* TRE_* */
+	uint32_t tr_a;			/* Arguments */
+	uint32_t tr_b;
+};
+
+#if OPT_TRACE
+
+/* Categories currently on; only tested, so no lock. */
+extern volatile unsigned trace_mask;
+
+void trace_record(unsigned event, uint32_t a, uint32_t b);
+
+/*
+ * Control, for the menu.
+ *
+ * trace_category looks up a category by name, returning 0 if
+ * there's no such name. trace_enable turns on the categories in
+ * MASK, allocating buffers for the cpus if they don't have them yet;
+ * trace_disable turns everything off. trace_clear empties the
+ * buffers. trace_dump prints what's in the buffers, merged across
+ * cpus in time order, either decoded or (with RAW) as hex words.
+ */
+unsigned trace_category(const char *name);
+int trace_enable(unsigned mask);
+void trace_disable(void);
+void trace_clear(void);
+void trace_dump(bool raw);
+
+#define TRACE(cat, ev, a, b) \
+	do { \
+		if (trace_mask & (cat)) { \
+			trace_record(ev, (uint32_t)(a), (uint32_t)(b)); \
+		} \
+	} while (0)
+
+#else
+
+#define TRACE(cat, ev, a, b)	((void)0)
+
+#endif
+
+#endif /* _TRACE_H_ */
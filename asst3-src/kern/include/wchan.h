@@ -36,6 +36,7 @@
 
 
 struct spinlock; /* in spinlock.h */
+struct thread; /* in thread.h */
 struct wchan; /* Opaque */
 
 /*
@@ -76,5 +77,14 @@ void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Move one thread sleeping on wait channel FROM to wait channel TO
+ * without waking it. Both channels must be associated with the same
+ * spinlock LK, which should be locked. Returns the thread moved, or
+ * NULL if FROM was empty.
+ */
+struct thread *wchan_moveone(struct wchan *from, struct wchan *to,
+			     struct spinlock *lk);
+
 
 #endif /* _WCHAN_H_ */
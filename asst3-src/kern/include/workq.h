@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _WORKQ_H_
+#define _WORKQ_H_
+
+/*
+ * Deferred work ("bottom halves") for interrupt handlers.
+ *
+ * An interrupt handler should do only what has to be done with the
+ * device's interrupt line asserted: read the status, acknowledge the
+ * interrupt, and note the result. Anything else (typically waking up
+ * whoever was waiting) can be queued as a work item, which runs on
+ * the same cpu once the outermost interrupt handler has finished and
+ * interrupts have been turned back on, or from the idle loop if that
+ * is what was interrupted.
+ *
+ * Work functions run in interrupt context and must not sleep. They
+ * may be interrupted, including by the interrupt that queues them.
+ *
+ * The caller provides the struct workitem, so queuing work never
+ * allocates memory.
+ */
+
+#include <spinlock.h>
+
+struct workitem {
+	struct workitem *wi_next;	/* Link in cpu's queue */
+	volatile spinlock_data_t wi_queued; /* Nonzero while queued */
+	void (*wi_func)(void *);	/* Function to run */
+	void *wi_data;			/* Argument for function */
+};
+
+/*
+ * workitem_init - set up WI to call FUNC(DATA).
+ * workq_schedule - queue WI to run on the current cpu. If WI is
+ *           already queued (on any cpu) this does nothing, so one run
+ *           of the function must handle everything that has happened
+ *           since it was queued.
+ */
+void workitem_init(struct workitem *wi, void (*func)(void *), void *data);
+void workq_schedule(struct workitem *wi);
+
+/*
+ * Run the current cpu's queued work, at the current spl (lowering it
+ * only between items). Called from the interrupt return path in
+ * mips_trap and from the idle loop.
+ */
+void workq_run(void);
+
+
+#endif /* _WORKQ_H_ */
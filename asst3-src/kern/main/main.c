@@ -47,6 +47,8 @@
 #include <vfs.h>
 #include <device.h>
 #include <pid.h>
+#include <rcu.h>
+#include <lockstat.h>
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
@@ -111,6 +113,7 @@ boot(void)
 	ram_bootstrap();
 	proc_bootstrap();
 	thread_bootstrap();
+	rcu_bootstrap();
 	pid_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
@@ -124,12 +127,15 @@ boot(void)
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
+	/* Needs the clock. */
+	lockstat_bootstrap();
 	kheap_nextgeneration();
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
 	kprintf_bootstrap();
 	exec_bootstrap();
+	futex_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
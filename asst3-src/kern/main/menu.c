@@ -45,8 +45,12 @@
 #include <pid.h>
 #include <syscall.h>
 #include <test.h>
+#include <trace.h>
+#include <prof.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
+#include "opt-trace.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -483,6 +487,117 @@ cmd_kheapgeneration(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_stats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		lockstat_dump();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+	}
+	else {
+		kprintf("Usage: lockstat [reset]\n");
+	}
+
+	return 0;
+}
+#endif
+
+#if OPT_TRACE
+/*
+ * Command for controlling and dumping the trace buffers.
+ */
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	unsigned mask;
+	int i, result;
+
+	if (nargs >= 2 && !strcmp(args[1], "on")) {
+		mask = nargs == 2 ? TRC_ALL : 0;
+		for (i=2; i<nargs; i++) {
+			if (trace_category(args[i]) == 0) {
+				kprintf("trace: No category %s\n", args[i]);
+				return EINVAL;
+			}
+			mask |= trace_category(args[i]);
+		}
+		result = trace_enable(mask);
+		if (result) {
+			kprintf("trace: %s\n", strerror(result));
+			return result;
+		}
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		trace_disable();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "clear")) {
+		trace_clear();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "dump")) {
+		trace_dump(false);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "raw")) {
+		trace_dump(true);
+	}
+	else {
+		kprintf("Usage: trace on [category...] | off | clear | "
+			"dump | raw\n");
+		kprintf("Categories: sched vm syscall disk lock all\n");
+	}
+
+	return 0;
+}
+#endif
+
+/*
+ * Command for the profiler.
+ */
+static
+int
+cmd_prof(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 2 && !strcmp(args[1], "start")) {
+		result = prof_start();
+		if (result) {
+			kprintf("prof: %s\n", strerror(result));
+			return result;
+		}
+	}
+	else if (nargs == 2 && !strcmp(args[1], "stop")) {
+		prof_stop();
+	}
+	else if (nargs == 1) {
+		prof_print(20);
+	}
+	else if (nargs == 2 && atoi(args[1]) > 0) {
+		prof_print(atoi(args[1]));
+	}
+	else {
+		kprintf("Usage: prof start | stop | [count]\n");
+	}
+
+	return 0;
+}
+
 static
 int
 cmd_kheapdump(int nargs, char **args)
@@ -569,6 +684,7 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[rt]  Real-time scheduling test     ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -576,6 +692,15 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[sy5] Lock latency test             ",
+	"[sy6] Rwlock test                   ",
+	"[sy7] Spinlock contention benchmark ",
+	"[bm1] Context switch benchmark      ",
+	"[bm2] Wakeup latency benchmark      ",
+	"[bm3] Cross-cpu wakeup benchmark    ",
+	"[bm4] Thread fork benchmark         ",
+	"[bm5] Lock benchmark                ",
+	"[bm]  All scheduler benchmarks      ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
@@ -606,6 +731,14 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[stats] Scheduler and cpu stats     ",
+	"[prof] Profiler [start|stop|count]  ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock stats [reset]       ",
+#endif
+#if OPT_TRACE
+	"[trace] Event tracing               ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +790,14 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "stats",      cmd_stats },
+	{ "prof",       cmd_prof },
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
+#if OPT_TRACE
+	{ "trace",      cmd_trace },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -673,12 +814,24 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "rt",	rttest },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	locklattest },
+	{ "sy6",	rwtest },
+	{ "sy7",	spinlockbench },
+
+	/* scheduler and locking benchmarks */
+	{ "bm1",	ctxswbench },
+	{ "bm2",	wakebench },
+	{ "bm3",	xcpuwakebench },
+	{ "bm4",	forkbench },
+	{ "bm5",	lockbench },
+	{ "bm",		schedbench },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -42,39 +42,144 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <rcu.h>
 #include <pid.h>
 
+/*
+ * List of pidinfo structures, linked through pi_next/pi_prev.
+ */
+struct pidlist {
+	struct pidinfo *pl_head;
+	struct pidinfo *pl_tail;
+};
+
 /*
  * Structure for holding exit data of a thread.
  *
  * If pi_ppid is INVALID_PID, the parent has gone away and will not be
  * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
  * structure can be freed.
+ *
+ * While the parent is around, a process is on exactly one of the
+ * parent's two lists: pi_kids until it exits, then pi_zombies, in
+ * the order the children exited, until it's collected. Waiting for
+ * any child is then just taking the head of pi_zombies. All of a
+ * process's waits sleep on its own pi_cv, which its children
+ * broadcast when they exit.
  */
 struct pidinfo {
 	pid_t pi_pid;			// process id of this thread
 	pid_t pi_ppid;			// process id of parent thread
 	volatile bool pi_exited;	// true if thread has exited
+	volatile bool pi_hidden;	// not yet visible to pid_wait
 	int pi_exitstatus;		// status (only valid if exited)
-	struct cv *pi_cv;		// use to wait for thread exit
+	struct threadstats pi_stats;	// accounting (only valid if exited)
+	struct cv *pi_cv;		// use to wait for children to exit
+	struct pidlist pi_kids;		// children still running
+	struct pidlist pi_zombies;	// children exited but not collected
+	struct pidinfo *pi_next;	// link on parent's list
+	struct pidinfo *pi_prev;	// link on parent's list
+	struct rcu_head pi_rcu;		// for freeing after readers finish
 };
 
 
 /*
  * Global pid and exit data.
  *
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * The process table is an array of slots. It starts with
+ * PIDTABLE_INITSLOTS entries and doubles, up to PROCS_MAX, whenever
+ * a pid is needed and every slot is taken. The low PIDSLOT_BITS bits
+ * of a pid are its slot and the rest are a generation number, so a
+ * lookup is one index and one compare.
+ *
+ * Free slots are kept on a FIFO list threaded through the table:
+ * pid_alloc takes the slot at the head and pi_drop puts it back on
+ * the tail, both in constant time. The FIFO order means a slot isn't
+ * reused until every other free slot has been, and each reuse gives
+ * out the next generation, so a pid number doesn't come back until
+ * its slot has been reused (PID_MAX+1) >> PIDSLOT_BITS times.
+ *
+ * Changes to the table are made holding pidlock. Pure lookups can
+ * instead use an RCU read section (see pi_lookup): neither pidinfo
+ * structures nor tables replaced by growing are freed until any such
+ * readers are done.
  */
+
+#define PIDSLOT_BITS		10
+#define PIDSLOT_MASK		((1 << PIDSLOT_BITS) - 1)
+#define PIDTABLE_INITSLOTS	64
+#define PIDSLOT_NONE		((unsigned)-1)
+
+#if PROCS_MAX > (1 << PIDSLOT_BITS)
+#error "PIDSLOT_BITS is too small for PROCS_MAX"
+#endif
+
+struct pidslot {
+	struct pidinfo *ps_info;	// process in this slot, if any
+	pid_t ps_nextpid;		// pid to give out from this slot next
+	unsigned ps_nextfree;		// free list link
+};
+
+struct pidtable {
+	unsigned pt_nslots;		// number of slots
+	struct pidslot *pt_slots;	// the slots
+	struct rcu_head pt_rcu;		// for freeing after growing
+};
+
 static struct lock *pidlock;		// lock for global exit data
-static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
-static pid_t nextpid;			// next candidate pid
+static struct pidtable *pidtable;	// the process table
+static unsigned freehead, freetail;	// free slot list
 static int nprocs;			// number of allocated pids
 
 
 
+/*
+ * pidlist operations.
+ */
+static
+void
+pidlist_init(struct pidlist *pl)
+{
+	pl->pl_head = pl->pl_tail = NULL;
+}
+
+static
+void
+pidlist_addtail(struct pidlist *pl, struct pidinfo *pi)
+{
+	KASSERT(pi->pi_next == NULL && pi->pi_prev == NULL);
+
+	pi->pi_prev = pl->pl_tail;
+	if (pl->pl_tail == NULL) {
+		pl->pl_head = pi;
+	}
+	else {
+		pl->pl_tail->pi_next = pi;
+	}
+	pl->pl_tail = pi;
+}
+
+static
+void
+pidlist_remove(struct pidlist *pl, struct pidinfo *pi)
+{
+	if (pi->pi_prev == NULL) {
+		KASSERT(pl->pl_head == pi);
+		pl->pl_head = pi->pi_next;
+	}
+	else {
+		pi->pi_prev->pi_next = pi->pi_next;
+	}
+	if (pi->pi_next == NULL) {
+		KASSERT(pl->pl_tail == pi);
+		pl->pl_tail = pi->pi_prev;
+	}
+	else {
+		pi->pi_next->pi_prev = pi->pi_prev;
+	}
+	pi->pi_next = pi->pi_prev = NULL;
+}
+
 /*
  * Create a pidinfo structure for the specified pid.
  */
@@ -100,7 +205,12 @@ pidinfo_create(pid_t pid, pid_t ppid)
 	pi->pi_pid = pid;
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
+	pi->pi_hidden = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	bzero(&pi->pi_stats, sizeof(pi->pi_stats));
+	pidlist_init(&pi->pi_kids);
+	pidlist_init(&pi->pi_zombies);
+	pi->pi_next = pi->pi_prev = NULL;
 
 	return pi;
 }
@@ -114,37 +224,176 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
+	KASSERT(pi->pi_kids.pl_head == NULL);
+	KASSERT(pi->pi_zombies.pl_head == NULL);
 	cv_destroy(pi->pi_cv);
 	kfree(pi);
 }
 
+/*
+ * RCU callback for pi_drop.
+ */
+static
+void
+pidinfo_destroy_rcu(void *vpi)
+{
+	pidinfo_destroy(vpi);
+}
+
 ////////////////////////////////////////////////////////////
 
+/*
+ * Create a process table with NSLOTS slots, copying the contents of
+ * OLD (if not NULL) into the beginning. The new slots are empty and
+ * not yet on the free list.
+ */
+static
+struct pidtable *
+pidtable_create(unsigned nslots, const struct pidtable *old)
+{
+	struct pidtable *pt;
+	unsigned i;
+
+	pt = kmalloc(sizeof(*pt));
+	if (pt == NULL) {
+		return NULL;
+	}
+	pt->pt_slots = kmalloc(nslots * sizeof(pt->pt_slots[0]));
+	if (pt->pt_slots == NULL) {
+		kfree(pt);
+		return NULL;
+	}
+	pt->pt_nslots = nslots;
+
+	i = 0;
+	if (old != NULL) {
+		KASSERT(old->pt_nslots <= nslots);
+		for (; i < old->pt_nslots; i++) {
+			pt->pt_slots[i] = old->pt_slots[i];
+		}
+	}
+	for (; i < nslots; i++) {
+		pt->pt_slots[i].ps_info = NULL;
+		pt->pt_slots[i].ps_nextpid = i < PID_MIN ?
+			i + (1 << PIDSLOT_BITS) : i;
+		pt->pt_slots[i].ps_nextfree = PIDSLOT_NONE;
+	}
+	return pt;
+}
+
+/*
+ * Free a process table.
+ */
+static
+void
+pidtable_destroy(struct pidtable *pt)
+{
+	kfree(pt->pt_slots);
+	kfree(pt);
+}
+
+/*
+ * RCU callback for pidtable_grow.
+ */
+static
+void
+pidtable_destroy_rcu(void *vpt)
+{
+	pidtable_destroy(vpt);
+}
+
+/*
+ * Put a slot on the tail of the free list.
+ */
+static
+void
+pidslot_free(unsigned slot)
+{
+	KASSERT(slot < pidtable->pt_nslots);
+	KASSERT(pidtable->pt_slots[slot].ps_info == NULL);
+
+	pidtable->pt_slots[slot].ps_nextfree = PIDSLOT_NONE;
+	if (freetail == PIDSLOT_NONE) {
+		freehead = slot;
+	}
+	else {
+		pidtable->pt_slots[freetail].ps_nextfree = slot;
+	}
+	freetail = slot;
+}
+
+/*
+ * Double the size of the process table, or fail with EAGAIN if it's
+ * already PROCS_MAX slots. The old table stays valid for any RCU
+ * readers still looking at it.
+ */
+static
+int
+pidtable_grow(void)
+{
+	struct pidtable *old, *pt;
+	unsigned nslots, i;
+
+	KASSERT(lock_do_i_hold(pidlock));
+
+	old = pidtable;
+	if (old->pt_nslots >= PROCS_MAX) {
+		return EAGAIN;
+	}
+	nslots = old->pt_nslots * 2;
+	if (nslots > PROCS_MAX) {
+		nslots = PROCS_MAX;
+	}
+
+	pt = pidtable_create(nslots, old);
+	if (pt == NULL) {
+		return ENOMEM;
+	}
+	rcu_assign_pointer(pidtable, pt);
+	call_rcu(&old->pt_rcu, pidtable_destroy_rcu, old);
+
+	for (i = old->pt_nslots; i < nslots; i++) {
+		pidslot_free(i);
+	}
+	return 0;
+}
+
 /*
  * pid_bootstrap: initialize.
  */
 void
 pid_bootstrap(void)
 {
-	int i;
+	struct pidinfo *pi;
+	unsigned i, slot;
 
 	pidlock = lock_create("pidlock");
 	if (pidlock == NULL) {
 		panic("Out of memory creating pid lock\n");
 	}
 
-	/* not really necessary - should start zeroed */
-	for (i=0; i<PROCS_MAX; i++) {
-		pidinfo[i] = NULL;
+	pidtable = pidtable_create(PIDTABLE_INITSLOTS, NULL);
+	if (pidtable == NULL) {
+		panic("Out of memory creating process table\n");
 	}
 
-	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
-	if (pidinfo[KERNEL_PID]==NULL) {
+	pi = pidinfo_create(KERNEL_PID, INVALID_PID);
+	if (pi == NULL) {
 		panic("Out of memory creating kernel pid data\n");
 	}
-
-	nextpid = PID_MIN;
+	pidtable->pt_slots[KERNEL_PID].ps_info = pi;
+	pidtable->pt_slots[KERNEL_PID].ps_nextpid =
+		KERNEL_PID + (1 << PIDSLOT_BITS);
 	nprocs = 1;
+
+	/* Hand out PID_MIN first, as before. */
+	freehead = freetail = PIDSLOT_NONE;
+	for (i=0; i<PIDTABLE_INITSLOTS; i++) {
+		slot = (i + PID_MIN) % PIDTABLE_INITSLOTS;
+		if (slot != KERNEL_PID) {
+			pidslot_free(slot);
+		}
+	}
 }
 
 /*
@@ -155,12 +404,50 @@ struct pidinfo *
 pi_get(pid_t pid)
 {
 	struct pidinfo *pi;
+	unsigned slot;
 
 	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
 	KASSERT(lock_do_i_hold(pidlock));
 
-	pi = pidinfo[pid % PROCS_MAX];
+	slot = pid & PIDSLOT_MASK;
+	if (slot >= pidtable->pt_nslots) {
+		return NULL;
+	}
+	pi = pidtable->pt_slots[slot].ps_info;
+	if (pi==NULL) {
+		return NULL;
+	}
+	if (pi->pi_pid != pid) {
+		return NULL;
+	}
+	return pi;
+}
+
+/*
+ * pi_lookup: like pi_get, but for use in an RCU read section instead
+ * of holding pidlock. The fields of the result can change at any
+ * moment unless pidlock is taken.
+ */
+static
+struct pidinfo *
+pi_lookup(pid_t pid)
+{
+	struct pidtable *pt;
+	struct pidinfo *pi;
+	unsigned slot;
+
+	KASSERT(pid>=0);
+	KASSERT(pid != INVALID_PID);
+	KASSERT(curthread->t_rcu_depth > 0);
+
+	/* Read the table pointer once; it may be replaced under us. */
+	pt = pidtable;
+	slot = pid & PIDSLOT_MASK;
+	if (slot >= pt->pt_nslots) {
+		return NULL;
+	}
+	pi = pt->pt_slots[slot].ps_info;
 	if (pi==NULL) {
 		return NULL;
 	}
@@ -178,52 +465,66 @@ static
 void
 pi_put(pid_t pid, struct pidinfo *pi)
 {
+	struct pidslot *ps;
+
 	KASSERT(lock_do_i_hold(pidlock));
 
 	KASSERT(pid != INVALID_PID);
 
-	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
-	pidinfo[pid % PROCS_MAX] = pi;
+	ps = &pidtable->pt_slots[pid & PIDSLOT_MASK];
+	KASSERT(ps->ps_info == NULL);
+	rcu_assign_pointer(ps->ps_info, pi);
 	nprocs++;
 }
 
 /*
  * pi_drop: remove a pidinfo structure from the process table and free
- * it. It should reflect a process that has already exited and been
- * waited for.
+ * it once no RCU reader can be looking at it. It should reflect a
+ * process that has already exited and been waited for. The slot goes
+ * to the back of the free list.
  */
 static
 void
 pi_drop(pid_t pid)
 {
 	struct pidinfo *pi;
+	unsigned slot;
 
 	KASSERT(lock_do_i_hold(pidlock));
 
-	pi = pidinfo[pid % PROCS_MAX];
+	slot = pid & PIDSLOT_MASK;
+	pi = pidtable->pt_slots[slot].ps_info;
 	KASSERT(pi != NULL);
 	KASSERT(pi->pi_pid == pid);
 
-	pidinfo_destroy(pi);
-	pidinfo[pid % PROCS_MAX] = NULL;
+	KASSERT(pi->pi_exited == true);
+	KASSERT(pi->pi_ppid == INVALID_PID);
+	pidtable->pt_slots[slot].ps_info = NULL;
+	call_rcu(&pi->pi_rcu, pidinfo_destroy_rcu, pi);
+	pidslot_free(slot);
 	nprocs--;
 }
 
 ////////////////////////////////////////////////////////////
 
 /*
- * Helper function for pid_alloc.
+ * Helper function for pid_alloc: advance a slot to its next
+ * generation, skipping the pids below PID_MIN.
  */
 static
 void
-inc_nextpid(void)
+pidslot_nextgen(struct pidslot *ps)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	pid_t pid;
 
-	nextpid++;
-	if (nextpid > PID_MAX) {
-		nextpid = PID_MIN;
+	pid = ps->ps_nextpid + (1 << PIDSLOT_BITS);
+	if (pid > PID_MAX) {
+		pid &= PIDSLOT_MASK;
+	}
+	if (pid < PID_MIN) {
+		pid += (1 << PIDSLOT_BITS);
 	}
+	ps->ps_nextpid = pid;
 }
 
 /*
@@ -232,36 +533,29 @@ inc_nextpid(void)
 int
 pid_alloc(pid_t *retval)
 {
-	struct pidinfo *pi;
+	struct pidinfo *pi, *parent;
+	struct pidslot *ps;
 	pid_t pid;
-	int count;
+	int result;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
 	/* lock the table */
 	lock_acquire(pidlock);
 
-	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
-		return EAGAIN;
-	}
-
-	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
-	 * forever.
-	 */
-	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
-
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
-		count++;
-
-		inc_nextpid();
+	if (freehead == PIDSLOT_NONE) {
+		result = pidtable_grow();
+		if (result) {
+			lock_release(pidlock);
+			return result;
+		}
+		KASSERT(freehead != PIDSLOT_NONE);
 	}
 
-	pid = nextpid;
+	ps = &pidtable->pt_slots[freehead];
+	KASSERT(ps->ps_info == NULL);
+	pid = ps->ps_nextpid;
+	KASSERT((unsigned)(pid & PIDSLOT_MASK) == freehead);
 
 	pi = pidinfo_create(pid, curproc->p_pid);
 	if (pi==NULL) {
@@ -269,9 +563,20 @@ pid_alloc(pid_t *retval)
 		return ENOMEM;
 	}
 
+	/* Take the slot off the free list. */
+	freehead = ps->ps_nextfree;
+	if (freehead == PIDSLOT_NONE) {
+		freetail = PIDSLOT_NONE;
+	}
+	ps->ps_nextfree = PIDSLOT_NONE;
+	pidslot_nextgen(ps);
+
 	pi_put(pid, pi);
 
-	inc_nextpid();
+	/* Put it on our list of children. */
+	parent = pi_get(curproc->p_pid);
+	KASSERT(parent != NULL);
+	pidlist_addtail(&parent->pi_kids, pi);
 
 	lock_release(pidlock);
 
@@ -279,6 +584,29 @@ pid_alloc(pid_t *retval)
 	return 0;
 }
 
+/*
+ * pi_orphan: take a child off its parent's lists and forget its
+ * parent, freeing it if it has already exited.
+ */
+static
+void
+pi_orphan(struct pidinfo *parent, struct pidinfo *pi)
+{
+	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(pi->pi_ppid == parent->pi_pid);
+
+	if (pi->pi_exited) {
+		pidlist_remove(&parent->pi_zombies, pi);
+	}
+	else {
+		pidlist_remove(&parent->pi_kids, pi);
+	}
+	pi->pi_ppid = INVALID_PID;
+	if (pi->pi_exited) {
+		pi_drop(pi->pi_pid);
+	}
+}
+
 /*
  * pid_unalloc - unallocate a process id (allocated with pid_alloc) that
  * hasn't run yet.
@@ -286,7 +614,7 @@ pid_alloc(pid_t *retval)
 void
 pid_unalloc(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
@@ -297,6 +625,10 @@ pid_unalloc(pid_t theirpid)
 	KASSERT(them->pi_exited == false);
 	KASSERT(them->pi_ppid == curproc->p_pid);
 
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+	pidlist_remove(&us->pi_kids, them);
+
 	/* keep pidinfo_destroy from complaining */
 	them->pi_exitstatus = 0xdead;
 	them->pi_exited = true;
@@ -304,6 +636,9 @@ pid_unalloc(pid_t theirpid)
 
 	pi_drop(theirpid);
 
+	/* Another thread may be waiting for it, or for any child. */
+	cv_broadcast(us->pi_cv, pidlock);
+
 	lock_release(pidlock);
 }
 
@@ -314,21 +649,61 @@ pid_unalloc(pid_t theirpid)
 void
 pid_disown(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
 	lock_acquire(pidlock);
 
+	/*
+	 * Another thread in this process may have collected it
+	 * already, in which case there's nothing to do.
+	 */
+	them = pi_get(theirpid);
+	if (them == NULL || them->pi_ppid != curproc->p_pid) {
+		lock_release(pidlock);
+		return;
+	}
+
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+	pi_orphan(us, them);
+
+	lock_release(pidlock);
+}
+
+/*
+ * pid_hide - keep a child that's still being set up out of sight of
+ * pid_wait: waiting for it fails with ESRCH and WAIT_ANY won't return
+ * it. If it exits while hidden, its status is thrown away and its pid
+ * freed. See sys_spawn.
+ */
+void
+pid_hide(pid_t theirpid)
+{
+	struct pidinfo *them;
+
+	lock_acquire(pidlock);
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
-	KASSERT(them->pi_ppid==curproc->p_pid);
+	KASSERT(them->pi_ppid == curproc->p_pid);
+	KASSERT(them->pi_exited == false);
+	them->pi_hidden = true;
+	lock_release(pidlock);
+}
 
-	them->pi_ppid = INVALID_PID;
-	if (them->pi_exited) {
-		pi_drop(them->pi_pid);
-	}
+/*
+ * pid_unhide - make the current process visible to its parent again.
+ */
+void
+pid_unhide(void)
+{
+	struct pidinfo *us;
 
+	lock_acquire(pidlock);
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+	us->pi_hidden = false;
 	lock_release(pidlock);
 }
 
@@ -341,58 +716,101 @@ pid_disown(pid_t theirpid)
  * subsequent reuse; thus we set curproc->p_pid to INVALID_PID.
  */
 void
-pid_setexitstatus(int status)
+pid_setexitstatus(int status, const struct threadstats *stats)
 {
-	struct pidinfo *us;
-	int i;
+	struct pidinfo *us, *parent;
 
 	lock_acquire(pidlock);
 	KASSERT(curproc->p_pid != INVALID_PID);
 
-	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
-		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
-			}
-		}
-	}
-
-	/* Now, wake up our parent */
 	us = pi_get(curproc->p_pid);
 	KASSERT(us != NULL);
 
+	/* First, disown all children */
+	while (us->pi_kids.pl_head != NULL) {
+		pi_orphan(us, us->pi_kids.pl_head);
+	}
+	while (us->pi_zombies.pl_head != NULL) {
+		pi_orphan(us, us->pi_zombies.pl_head);
+	}
+
 	us->pi_exitstatus = status;
-	us->pi_exited = true;
+	us->pi_stats = *stats;
+
+	if (us->pi_hidden && us->pi_ppid != INVALID_PID) {
+		/*
+		 * Our parent never saw us (see pid_hide); leave
+		 * quietly, but wake it in case a WAIT_ANY was
+		 * counting on us.
+		 */
+		parent = pi_get(us->pi_ppid);
+		KASSERT(parent != NULL);
+		pidlist_remove(&parent->pi_kids, us);
+		us->pi_ppid = INVALID_PID;
+		cv_broadcast(parent->pi_cv, pidlock);
+	}
 
 	if (us->pi_ppid == INVALID_PID) {
 		/* no parent */
+		us->pi_exited = true;
 		pi_drop(curproc->p_pid);
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		/* Move to the parent's zombie queue and wake it up. */
+		parent = pi_get(us->pi_ppid);
+		KASSERT(parent != NULL);
+		pidlist_remove(&parent->pi_kids, us);
+		us->pi_exited = true;
+		pidlist_addtail(&parent->pi_zombies, us);
+		cv_broadcast(parent->pi_cv, pidlock);
 	}
 
 	curproc->p_pid = INVALID_PID;
 	lock_release(pidlock);
 }
 
+/*
+ * pi_collect: hand back an exited child's status and free it.
+ */
+static
+void
+pi_collect(struct pidinfo *us, struct pidinfo *them, int *status,
+	   pid_t *ret, struct threadstats *stats)
+{
+	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(them->pi_exited == true);
+	KASSERT(them->pi_ppid == us->pi_pid);
+
+	if (status != NULL) {
+		*status = them->pi_exitstatus;
+	}
+	if (ret != NULL) {
+		*ret = them->pi_pid;
+	}
+	*stats = them->pi_stats;
+
+	pi_orphan(us, them);
+}
+
 /*
  * Waits on a pid, returning the exit status when it's available.
  * status and ret are a kernel pointers, but pid/flags may come from
  * userland and may thus be maliciously invalid.
  *
+ * theirpid may be WAIT_ANY, to collect whichever child exits first.
+ * As there are no process groups, every process is in the same group
+ * as its children, so WAIT_MYPGRP (which is INVALID_PID) means the
+ * same thing. Other negative values name a process group and aren't
+ * supported.
+ *
  * status may be null, in which case the status is thrown away. ret
  * may only be null if WNOHANG is not set.
  */
 int
 pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
+	struct threadstats stats;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
@@ -401,12 +819,10 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	/*
-	 * We don't support the Unix meanings of negative pids or 0
-	 * (0 is INVALID_PID) and other code may break on them, so
-	 * check now.
-	 */
-	if (theirpid == INVALID_PID || theirpid<0) {
+	if (theirpid == WAIT_MYPGRP) {
+		theirpid = WAIT_ANY;
+	}
+	if (theirpid < 0 && theirpid != WAIT_ANY) {
 		return ENOSYS;
 	}
 
@@ -415,51 +831,82 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
+	/*
+	 * For a particular pid, try without the lock first. If
+	 * there's no such process, or it's our child and with
+	 * WNOHANG it hasn't exited, that's the answer; otherwise we
+	 * need the lock to wait for it or collect it.
+	 */
+	if (theirpid != WAIT_ANY) {
+		rcu_read_lock();
+		them = pi_lookup(theirpid);
+		if (them == NULL || them->pi_hidden) {
+			rcu_read_unlock();
+			return ESRCH;
+		}
+		if (flags == WNOHANG && them->pi_ppid == curproc->p_pid &&
+		    !them->pi_exited) {
+			rcu_read_unlock();
+			KASSERT(ret != NULL);
+			*ret = 0;
+			return 0;
+		}
+		rcu_read_unlock();
+	}
+
 	lock_acquire(pidlock);
 
-	them = pi_get(theirpid);
-	if (them==NULL) {
-		lock_release(pidlock);
-		return ESRCH;
-	}
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
 
-	KASSERT(them->pi_pid==theirpid);
+	/*
+	 * Our children all wake us through us->pi_cv, and other
+	 * threads in this process may be collecting them too, so
+	 * recheck everything after each wait.
+	 */
+	while (1) {
+		if (theirpid == WAIT_ANY) {
+			them = us->pi_zombies.pl_head;
+			if (them != NULL) {
+				break;
+			}
+			if (us->pi_kids.pl_head == NULL) {
+				lock_release(pidlock);
+				return ECHILD;
+			}
+		}
+		else {
+			them = pi_get(theirpid);
+			if (them==NULL || them->pi_hidden) {
+				lock_release(pidlock);
+				return ESRCH;
+			}
+			KASSERT(them->pi_pid==theirpid);
 
-	/* Only allow waiting for own children. */
-	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
-		return EPERM;
-	}
+			/* Only allow waiting for own children. */
+			if (them->pi_ppid != curproc->p_pid) {
+				lock_release(pidlock);
+				return EPERM;
+			}
+			if (them->pi_exited) {
+				break;
+			}
+		}
 
-	if (them->pi_exited == false) {
 		if (flags == WNOHANG) {
 			lock_release(pidlock);
 			KASSERT(ret != NULL);
 			*ret = 0;
 			return 0;
 		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+		cv_wait(us->pi_cv, pidlock);
 	}
 
-	if (status != NULL) {
-		*status = them->pi_exitstatus;
-	}
-	if (ret != NULL) {
-		/*
-		 * In Unix you can wait for any of several possible
-		 * processes by passing particular magic values of
-		 * pid. wait then returns the pid you actually
-		 * found. We don't support this, so always return the
-		 * pid we looked for.
-		 */
-		*ret = theirpid;
-	}
-
-	them->pi_ppid = 0;
-	pi_drop(them->pi_pid);
+	pi_collect(us, them, status, ret, &stats);
 
 	lock_release(pidlock);
+
+	/* Collecting the child charges its usage to us (see getrusage). */
+	proc_addchildstats(curproc, &stats);
 	return 0;
 }
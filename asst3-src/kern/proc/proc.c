@@ -38,12 +38,14 @@
  * things they point to. Rearrange this (and/or change it to be a
  * regular lock) as needed.
  *
- * Unless you're implementing multithreaded user processes, the only
- * process that will have more than one thread is the kernel process.
+ * User processes can have more than one thread; see threadfork. The
+ * thread bookkeeping is protected by p_threadslock, which is also
+ * what protects p_threads.
  */
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/wait.h>
 #include <spl.h>
 #include <synch.h>
 #include <proc.h>
@@ -85,11 +87,29 @@ proc_create(const char *name)
 	}
 	threadarray_init(&proc->p_threads);
 
+	proc->p_threadcv = cv_create("p_threads");
+	if (proc->p_threadcv == NULL) {
+		threadarray_cleanup(&proc->p_threads);
+		lock_destroy(proc->p_threadslock);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+	proc->p_nuthreads = 0;
+	proc->p_tidsused = 0;
+	proc->p_tidsexited = 0;
+	proc->p_stacksdefined = PROC_TIDBIT(0);
+	proc->p_exiting = false;
+	proc->p_exitstatus = 0;
+	bzero(&proc->p_stats, sizeof(proc->p_stats));
+	bzero(&proc->p_childstats, sizeof(proc->p_childstats));
+
 	spinlock_init(&proc->p_lock);
 	proc->p_pid = INVALID_PID;
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
+	proc->p_vforkdone = NULL;
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
@@ -185,6 +205,7 @@ proc_destroy(struct proc *proc)
 	KASSERT(proc->p_pid == INVALID_PID);
 	spinlock_cleanup(&proc->p_lock);
 	threadarray_cleanup(&proc->p_threads);
+	cv_destroy(proc->p_threadcv);
 	lock_destroy(proc->p_threadslock);
 
 	kfree(proc->p_name);
@@ -230,6 +251,10 @@ proc_create_runprogram(const char *name, struct proc **ret)
 		return result;
 	}
 
+	/* It starts with one thread, on the main stack */
+	newproc->p_nuthreads = 1;
+	newproc->p_tidsused = PROC_TIDBIT(0);
+
 	/* VM fields */
 
 	newproc->p_addrspace = NULL;
@@ -261,9 +286,13 @@ proc_create_runprogram(const char *name, struct proc **ret)
  * However, the new thread always inherits its current working
  * directory from the caller. The new thread is given no address space
  * (the caller decides that).
+ *
+ * For vfork, VFORKDONE is non-null and the address space is shared
+ * rather than copied.
  */
+static
 int
-proc_fork(struct proc **ret)
+proc_clone(struct semaphore *vforkdone, struct proc **ret)
 {
 	struct proc *newproc;
 	struct addrspace *as;
@@ -291,9 +320,24 @@ proc_fork(struct proc **ret)
 	}
 #endif
 
+	/*
+	 * The new process has one thread, a copy of this one, with the
+	 * same id so it stays on the same stack.
+	 */
+	lock_acquire(curproc->p_threadslock);
+	newproc->p_stacksdefined = curproc->p_stacksdefined;
+	lock_release(curproc->p_threadslock);
+	newproc->p_nuthreads = 1;
+	newproc->p_tidsused = PROC_TIDBIT(curthread->t_tid);
+
 	/* VM fields */
 	as = proc_getas();
-	if (as != NULL) {
+	if (vforkdone != NULL) {
+		KASSERT(as != NULL);
+		newproc->p_addrspace = as;
+		newproc->p_vforkdone = vforkdone;
+	}
+	else if (as != NULL) {
 		result = as_copy(as, &newproc->p_addrspace);
 		if (result) {
 			pid_unalloc(newproc->p_pid);
@@ -308,7 +352,9 @@ proc_fork(struct proc **ret)
 	if (tbl != NULL) {
 		result = filetable_copy(tbl, &newproc->p_filetable);
 		if (result) {
-			as_destroy(newproc->p_addrspace);
+			if (vforkdone == NULL) {
+				as_destroy(newproc->p_addrspace);
+			}
 			newproc->p_addrspace = NULL;
 			pid_unalloc(newproc->p_pid);
 			newproc->p_pid = INVALID_PID;
@@ -333,12 +379,49 @@ proc_fork(struct proc **ret)
 	return 0;
 }
 
+int
+proc_fork(struct proc **ret)
+{
+	return proc_clone(NULL, ret);
+}
+
+int
+proc_vfork(struct semaphore *done, struct proc **ret)
+{
+	KASSERT(done != NULL);
+	return proc_clone(done, ret);
+}
+
+/*
+ * Give a borrowed address space back to the vfork parent. By now the
+ * current process must have stopped using it (switched to a new one
+ * or to none) since the parent will carry on with it straight away.
+ */
+bool
+proc_vforkdone(void)
+{
+	struct semaphore *done;
+
+	done = curproc->p_vforkdone;
+	if (done == NULL) {
+		return false;
+	}
+	curproc->p_vforkdone = NULL;
+	V(done);
+	return true;
+}
+
 /*
  * Undo proc_fork if nothing's run in the new process yet.
  */
 void
 proc_unfork(struct proc *newproc)
 {
+	if (newproc->p_vforkdone != NULL) {
+		/* Not ours to destroy. */
+		newproc->p_addrspace = NULL;
+		newproc->p_vforkdone = NULL;
+	}
 	pid_unalloc(newproc->p_pid);
 	newproc->p_pid = INVALID_PID;
 	proc_destroy(newproc);
@@ -346,6 +429,10 @@ proc_unfork(struct proc *newproc)
 
 /*
  * Make the current process exit.
+ *
+ * There's no way to stop the process's other threads, so they carry
+ * on; the current one leaves, and the process exits with STATUS
+ * when the last of them does (see proc_threadexit).
  */
 void
 proc_exit(int status)
@@ -355,23 +442,214 @@ proc_exit(int status)
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
 
-	/* Set exit status and wake up anyone waiting for us. */
-	pid_setexitstatus(status);
+	lock_acquire(proc->p_threadslock);
+	if (!proc->p_exiting) {
+		proc->p_exiting = true;
+		proc->p_exitstatus = status;
+	}
+	lock_release(proc->p_threadslock);
+
+	proc_threadexit(0);
+}
+
+/*
+ * Make the current thread exit from its process, leaving STATUS for
+ * threadjoin. If it's the last one, the process exits.
+ */
+void
+proc_threadexit(int status)
+{
+	struct proc *proc = curproc;
+	unsigned tid = curthread->t_tid;
+	struct threadstats stats;
+	bool last;
+
+	KASSERT(proc != kproc);
+	KASSERT(tid < PROC_MAXTHREADS);
+
+	lock_acquire(proc->p_threadslock);
+	KASSERT(proc->p_tidsused & PROC_TIDBIT(tid));
+	KASSERT(proc->p_nuthreads > 0);
+	proc->p_tidstatus[tid] = status;
+	proc->p_tidsexited |= PROC_TIDBIT(tid);
+	proc->p_nuthreads--;
+	last = proc->p_nuthreads == 0;
+	if (last) {
+		/*
+		 * Wait for the others to finish detaching (which
+		 * signals p_threadcv) so nothing else refers to the
+		 * process when we destroy it.
+		 */
+		while (threadarray_num(&proc->p_threads) > 1) {
+			cv_wait(proc->p_threadcv, proc->p_threadslock);
+		}
+		status = proc->p_exiting ? proc->p_exitstatus :
+			_MKWAIT_EXIT(0);
+
+		/* Everyone else has left; add ourselves and the kids. */
+		stats = proc->p_stats;
+		threadstats_add(&stats, &curthread->t_stats);
+		threadstats_add(&stats, &proc->p_childstats);
+	}
+	else {
+		cv_broadcast(proc->p_threadcv, proc->p_threadslock);
+	}
+	lock_release(proc->p_threadslock);
+
+	if (last) {
+		/* If we borrowed our address space with vfork, give it back. */
+		if (proc->p_vforkdone != NULL) {
+			proc_setas(NULL);
+			as_deactivate();
+			proc_vforkdone();
+		}
+
+		/* Set exit status and wake up anyone waiting for us. */
+		pid_setexitstatus(status, &stats);
+	}
 
 	/* Detach from the process and attach to the kernel process. */
 	KASSERT(curthread->t_proc == proc);
 	proc_remthread(curthread);
 	proc_addthread(kproc, curthread);
 
-	/* There should be no threads left in the target process. */
-	KASSERT(threadarray_num(&proc->p_threads) == 0);
+	if (last) {
+		/* There should be no threads left in the target process. */
+		KASSERT(threadarray_num(&proc->p_threads) == 0);
 
-	/* Now we can destroy the process. */
-	proc_destroy(proc);
+		/* Now we can destroy the process. */
+		proc_destroy(proc);
+	}
 
 	thread_exit();
 }
 
+/*
+ * Reserve a thread id in the current process for a new user thread,
+ * setting up its stack slot if it hasn't been used before.
+ */
+int
+proc_newthread(unsigned *tidret, vaddr_t *stackptr)
+{
+	struct proc *proc = curproc;
+	unsigned tid;
+	int result;
+
+	/* The stacks would go in the vfork parent's address space. */
+	if (proc->p_vforkdone != NULL) {
+		return EINVAL;
+	}
+
+	lock_acquire(proc->p_threadslock);
+	for (tid=1; tid<PROC_MAXTHREADS; tid++) {
+		if ((proc->p_tidsused & PROC_TIDBIT(tid)) == 0) {
+			break;
+		}
+	}
+	if (tid == PROC_MAXTHREADS) {
+		lock_release(proc->p_threadslock);
+		return EAGAIN;
+	}
+
+	if ((proc->p_stacksdefined & PROC_TIDBIT(tid)) == 0) {
+		result = as_define_threadstack(proc_getas(), tid);
+		if (result) {
+			lock_release(proc->p_threadslock);
+			return result;
+		}
+		proc->p_stacksdefined |= PROC_TIDBIT(tid);
+	}
+
+	proc->p_tidsused |= PROC_TIDBIT(tid);
+	proc->p_nuthreads++;
+	lock_release(proc->p_threadslock);
+
+	*tidret = tid;
+	*stackptr = as_threadstack(tid);
+	return 0;
+}
+
+/*
+ * Undo proc_newthread if the thread never ran.
+ */
+void
+proc_unnewthread(unsigned tid)
+{
+	struct proc *proc = curproc;
+
+	lock_acquire(proc->p_threadslock);
+	KASSERT(proc->p_tidsused & PROC_TIDBIT(tid));
+	proc->p_tidsused &= ~PROC_TIDBIT(tid);
+	proc->p_nuthreads--;
+	lock_release(proc->p_threadslock);
+}
+
+/*
+ * Wait for thread TID of the current process to exit, and release
+ * its id.
+ */
+int
+proc_threadjoin(unsigned tid, int *status)
+{
+	struct proc *proc = curproc;
+
+	if (tid >= PROC_MAXTHREADS || tid == curthread->t_tid) {
+		return EINVAL;
+	}
+
+	lock_acquire(proc->p_threadslock);
+	while ((proc->p_tidsused & PROC_TIDBIT(tid)) != 0 &&
+	       (proc->p_tidsexited & PROC_TIDBIT(tid)) == 0) {
+		cv_wait(proc->p_threadcv, proc->p_threadslock);
+	}
+	if ((proc->p_tidsused & PROC_TIDBIT(tid)) == 0) {
+		/* No such thread, or someone else joined it first. */
+		lock_release(proc->p_threadslock);
+		return ESRCH;
+	}
+	*status = proc->p_tidstatus[tid];
+	proc->p_tidsused &= ~PROC_TIDBIT(tid);
+	proc->p_tidsexited &= ~PROC_TIDBIT(tid);
+	lock_release(proc->p_threadslock);
+
+	return 0;
+}
+
+/*
+ * Check that the current thread is the only one left running in its
+ * process.
+ */
+bool
+proc_singlethreaded(void)
+{
+	struct proc *proc = curproc;
+	bool ret;
+
+	lock_acquire(proc->p_threadslock);
+	ret = proc->p_nuthreads == 1;
+	lock_release(proc->p_threadslock);
+	return ret;
+}
+
+/*
+ * After execv: the address space is new, so only the main stack
+ * exists, and the thread carries on as thread 0. Exited threads
+ * nobody joined are forgotten.
+ */
+void
+proc_execreset(void)
+{
+	struct proc *proc = curproc;
+
+	lock_acquire(proc->p_threadslock);
+	KASSERT(proc->p_nuthreads == 1);
+	proc->p_tidsused = PROC_TIDBIT(0);
+	proc->p_tidsexited = 0;
+	proc->p_stacksdefined = PROC_TIDBIT(0);
+	curthread->t_tid = 0;
+	lock_release(proc->p_threadslock);
+}
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -428,6 +706,11 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			/* Keep its usage; it starts over elsewhere. */
+			threadstats_add(&proc->p_stats, &t->t_stats);
+			bzero(&t->t_stats, sizeof(t->t_stats));
+			/* proc_threadexit may be waiting for this */
+			cv_broadcast(proc->p_threadcv, proc->p_threadslock);
 			lock_release(proc->p_threadslock);
 			goto finish;
 		}
@@ -442,6 +725,41 @@ finish:
 	splx(spl);
 }
 
+/*
+ * Get the usage of PROC's threads, past and present, or of its
+ * collected children.
+ */
+void
+proc_getstats(struct proc *proc, bool children, struct threadstats *ret)
+{
+	unsigned num, i;
+
+	lock_acquire(proc->p_threadslock);
+	if (children) {
+		*ret = proc->p_childstats;
+	}
+	else {
+		*ret = proc->p_stats;
+		num = threadarray_num(&proc->p_threads);
+		for (i=0; i<num; i++) {
+			threadstats_add(ret,
+				&threadarray_get(&proc->p_threads, i)->t_stats);
+		}
+	}
+	lock_release(proc->p_threadslock);
+}
+
+/*
+ * Charge a collected child's usage to PROC.
+ */
+void
+proc_addchildstats(struct proc *proc, const struct threadstats *stats)
+{
+	lock_acquire(proc->p_threadslock);
+	threadstats_add(&proc->p_childstats, stats);
+	lock_release(proc->p_threadslock);
+}
+
 /*
  * Fetch the address space of (the current) process.
  *
@@ -34,6 +34,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
 #include <openfile.h>
 #include <filetable.h>
 
@@ -52,6 +53,12 @@ filetable_create(void)
 		return NULL;
 	}
 
+	ft->ft_rwlock = rwlock_create("filetable");
+	if (ft->ft_rwlock == NULL) {
+		kfree(ft);
+		return NULL;
+	}
+
 	/* the table starts empty */
 	for (fd = 0; fd < OPEN_MAX; fd++) {
 		ft->ft_openfiles[fd] = NULL;
@@ -77,6 +84,7 @@ filetable_destroy(struct filetable *ft)
 			ft->ft_openfiles[fd] = NULL;
 		}
 	}
+	rwlock_destroy(ft->ft_rwlock);
 	kfree(ft);
 }
 
@@ -114,6 +122,7 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 	}
 
 	/* share the entries */
+	rwlock_acquire_read(src->ft_rwlock);
 	for (fd = 0; fd < OPEN_MAX; fd++) {
 		file = src->ft_openfiles[fd];
 		if (file != NULL) {
@@ -121,6 +130,7 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		}
 		dest->ft_openfiles[fd] = file;
 	}
+	rwlock_release_read(src->ft_rwlock);
 
 	*dest_ret = dest;
 	return 0;
@@ -155,36 +165,33 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 		return EBADF;
 	}
 
+	rwlock_acquire_read(ft->ft_rwlock);
 	file = ft->ft_openfiles[fd];
 	if (file == NULL) {
+		rwlock_release_read(ft->ft_rwlock);
 		return EBADF;
 	}
+	openfile_incref(file);
+	rwlock_release_read(ft->ft_rwlock);
 
 	*ret = file;
 	return 0;
 }
 
 /*
- * Put a file handle back when done with it. This does not actually do
- * anything (other than crosscheck) but it's always good practice to
- * build things so when you take them out you put them back again
- * rather than dropping them on the floor. Then if you need to do
- * something at cleanup time you can put it in this function instead
- * of having to hunt for all the places to insert the new logic.
- *
- * (For example, if you have multithreaded processes you will need to
- * insert additional lock and/or refcount manipulations here and in
- * filetable_get.)
+ * Put a file handle back when done with it. This drops the reference
+ * filetable_get took, which may be the last one if another thread
+ * closed the file in the meantime.
  *
  * The openfile should be the one returned from filetable_get. If you
- * want to manipulate the table so the assertion's no longer true, get
- * your own reference to the openfile (with openfile_incref) and call
- * filetable_put before mucking about.
+ * want to keep using it afterwards, get your own reference to the
+ * openfile (with openfile_incref) first.
  */
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
-	KASSERT(ft->ft_openfiles[fd] == file);
+	KASSERT(filetable_okfd(ft, fd));
+	openfile_decref(file);
 }
 
 /*
@@ -202,13 +209,16 @@ filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
 	int fd;
 
+	rwlock_acquire_write(ft->ft_rwlock);
 	for (fd = 0; fd < OPEN_MAX; fd++) {
 		if (ft->ft_openfiles[fd] == NULL) {
 			ft->ft_openfiles[fd] = file;
+			rwlock_release_write(ft->ft_rwlock);
 			*fd_ret = fd;
 			return 0;
 		}
 	}
+	rwlock_release_write(ft->ft_rwlock);
 
 	return EMFILE;
 }
@@ -232,6 +242,8 @@ filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 {
 	KASSERT(filetable_okfd(ft, fd));
 
+	rwlock_acquire_write(ft->ft_rwlock);
 	*oldfile_ret = ft->ft_openfiles[fd];
 	ft->ft_openfiles[fd] = newfile;
+	rwlock_release_write(ft->ft_rwlock);
 }
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes: wait-if-equal and wake for user-level synchronization.
+ *
+ * A futex is just an int in user memory. User code does all the
+ * uncontended work itself with atomic instructions and only calls in
+ * here to sleep on the int (futex_wait) or to wake sleepers
+ * (futex_wake). Nothing is allocated per futex; waiters are keyed by
+ * (address space, user address) and hashed into a fixed table of
+ * buckets, each with a spinlock, a wait channel, and a list of the
+ * waiters in it.
+ *
+ * The check-and-sleep in futex_wait has to be atomic with respect to
+ * futex_wake, but we can't copyin while holding a spinlock (it can
+ * fault). So each bucket carries a wake sequence number: we sample
+ * it, read the user value without the lock, and then only go to
+ * sleep if no wake has happened in the bucket in between. A wake
+ * that lands in that window makes us return at once, which callers
+ * must tolerate anyway since wakeups can be spurious.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+#define FUTEX_NBUCKETS 64
+
+struct futex_waiter {
+	struct addrspace *fw_as;
+	userptr_t fw_addr;
+	bool fw_woken;
+	struct futex_waiter *fw_next;
+};
+
+static struct futex_bucket {
+	struct spinlock fb_lock;
+	struct wchan *fb_wchan;
+	unsigned fb_seq;
+	struct futex_waiter *fb_waiters;	/* oldest first */
+	struct futex_waiter **fb_tailp;		/* last link in fb_waiters */
+} futex_buckets[FUTEX_NBUCKETS];
+
+/*
+ * Set things up.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		futex_buckets[i].fb_wchan = wchan_create("futex");
+		if (futex_buckets[i].fb_wchan == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		spinlock_init(&futex_buckets[i].fb_lock);
+		futex_buckets[i].fb_seq = 0;
+		futex_buckets[i].fb_waiters = NULL;
+		futex_buckets[i].fb_tailp = &futex_buckets[i].fb_waiters;
+	}
+}
+
+/*
+ * Choose the bucket for a futex.
+ */
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, userptr_t addr)
+{
+	uintptr_t h;
+
+	h = (uintptr_t)addr / sizeof(int);
+	h ^= (uintptr_t)as / sizeof(void *);
+	h ^= h >> 11;
+	return &futex_buckets[h % FUTEX_NBUCKETS];
+}
+
+/*
+ * Sleep until woken, provided the int at ADDR still holds VAL.
+ * Returns EAGAIN if it doesn't.
+ */
+int
+sys_futex_wait(userptr_t addr, int val)
+{
+	struct addrspace *as;
+	struct futex_bucket *fb;
+	struct futex_waiter fw;
+	unsigned seq;
+	int cur;
+	int result;
+
+	if ((uintptr_t)addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	fb = futex_hash(as, addr);
+
+	spinlock_acquire(&fb->fb_lock);
+	seq = fb->fb_seq;
+	spinlock_release(&fb->fb_lock);
+
+	result = copyin(addr, &cur, sizeof(cur));
+	if (result) {
+		return result;
+	}
+	if (cur != val) {
+		return EAGAIN;
+	}
+
+	spinlock_acquire(&fb->fb_lock);
+	if (fb->fb_seq != seq) {
+		/* Someone woke the bucket meanwhile; treat as a wakeup. */
+		spinlock_release(&fb->fb_lock);
+		return 0;
+	}
+
+	fw.fw_as = as;
+	fw.fw_addr = addr;
+	fw.fw_woken = false;
+	fw.fw_next = NULL;
+
+	/* Queue at the tail so wakes go to the longest waiter first. */
+	*fb->fb_tailp = &fw;
+	fb->fb_tailp = &fw.fw_next;
+
+	while (!fw.fw_woken) {
+		wchan_sleep(fb->fb_wchan, &fb->fb_lock);
+	}
+	spinlock_release(&fb->fb_lock);
+
+	return 0;
+}
+
+/*
+ * Wake up to N threads sleeping on the int at ADDR. Returns the
+ * number woken.
+ */
+int
+sys_futex_wake(userptr_t addr, int n, int *retval)
+{
+	struct addrspace *as;
+	struct futex_bucket *fb;
+	struct futex_waiter **fwp, *fw;
+	int count;
+
+	if ((uintptr_t)addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	if (n < 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	fb = futex_hash(as, addr);
+	count = 0;
+
+	spinlock_acquire(&fb->fb_lock);
+	fb->fb_seq++;
+	fwp = &fb->fb_waiters;
+	while (*fwp != NULL && count < n) {
+		fw = *fwp;
+		if (fw->fw_as == as && fw->fw_addr == addr) {
+			*fwp = fw->fw_next;
+			if (fb->fb_tailp == &fw->fw_next) {
+				fb->fb_tailp = fwp;
+			}
+			fw->fw_woken = true;
+			count++;
+		}
+		else {
+			fwp = &fw->fw_next;
+		}
+	}
+	if (count > 0) {
+		/* Other futexes share the channel; they recheck and resleep. */
+		wchan_wakeall(fb->fb_wchan, &fb->fb_lock);
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = count;
+	return 0;
+}
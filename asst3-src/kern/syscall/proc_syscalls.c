@@ -42,6 +42,7 @@
 #include <current.h>
 #include <copyinout.h>
 #include <pid.h>
+#include <synch.h>
 #include <syscall.h>
 
 /* note that sys_execv is in runprogram.c */
@@ -81,12 +82,13 @@ sys__exit(int status)
 
 static
 void
-fork_newthread(void *vtf, unsigned long junk)
+fork_newthread(void *vtf, unsigned long tid)
 {
 	struct trapframe mytf;
 	struct trapframe *ntf = vtf;
 
-	(void)junk;
+	/* We're a copy of the forking thread, on the same stack. */
+	curthread->t_tid = tid;
 
 	/*
 	 * Now copy the trapframe to our stack, so we can free the one
@@ -100,8 +102,14 @@ fork_newthread(void *vtf, unsigned long junk)
 	enter_forked_process(&mytf);
 }
 
+/*
+ * Common code for fork and vfork. For vfork, VFORKDONE is the
+ * semaphore the new process signals when it gives back the address
+ * space it borrowed.
+ */
+static
 int
-sys_fork(struct trapframe *tf, pid_t *retval)
+dofork(struct trapframe *tf, struct semaphore *vforkdone, pid_t *retval)
 {
 	struct trapframe *ntf;
 	int result;
@@ -119,7 +127,12 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	}
 	*ntf = *tf;
 
-	result = proc_fork(&newproc);
+	if (vforkdone != NULL) {
+		result = proc_vfork(vforkdone, &newproc);
+	}
+	else {
+		result = proc_fork(&newproc);
+	}
 	if (result) {
 		kfree(ntf);
 		return result;
@@ -127,7 +140,7 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	*retval = newproc->p_pid;
 
 	result = thread_fork(curthread->t_name, newproc,
-			     fork_newthread, ntf, 0);
+			     fork_newthread, ntf, curthread->t_tid);
 	if (result) {
 		proc_unfork(newproc);
 		kfree(ntf);
@@ -137,6 +150,139 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	return 0;
 }
 
+int
+sys_fork(struct trapframe *tf, pid_t *retval)
+{
+	return dofork(tf, NULL, retval);
+}
+
+/*
+ * sys_vfork
+ *
+ * Like fork, but the child runs in our address space instead of a
+ * copy of it, and we wait until it's done with it: until it execs or
+ * exits. This makes fork-then-exec cost the same however big we are.
+ * As usual for vfork, the child must not return from the function
+ * that called vfork or change anything the parent relies on.
+ *
+ * Only the calling thread waits. It can't exit meanwhile, so the
+ * process and its address space stay put.
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+	struct semaphore *done;
+	int result;
+
+	done = sem_create("vfork", 0);
+	if (done == NULL) {
+		return ENOMEM;
+	}
+
+	result = dofork(tf, done, retval);
+	if (result) {
+		sem_destroy(done);
+		return result;
+	}
+
+	P(done);
+	sem_destroy(done);
+	return 0;
+}
+
+/*
+ * sys___threadfork
+ *
+ * Start a new thread in the current process, calling START(ARG) on a
+ * stack of its own. Userland wraps this as threadfork(), with a START
+ * that calls threadexit if the thread function returns.
+ */
+
+struct threadfork_args {
+	vaddr_t tfa_start;
+	userptr_t tfa_arg;
+	vaddr_t tfa_stack;
+};
+
+static
+void
+threadfork_newthread(void *vargs, unsigned long tid)
+{
+	struct threadfork_args args;
+
+	curthread->t_tid = tid;
+
+	args = *(struct threadfork_args *)vargs;
+	kfree(vargs);
+
+	enter_new_thread(args.tfa_arg, args.tfa_stack, args.tfa_start);
+}
+
+int
+sys___threadfork(userptr_t start, userptr_t arg, int *retval)
+{
+	struct threadfork_args *args;
+	unsigned tid;
+	int result;
+
+	args = kmalloc(sizeof(*args));
+	if (args == NULL) {
+		return ENOMEM;
+	}
+
+	result = proc_newthread(&tid, &args->tfa_stack);
+	if (result) {
+		kfree(args);
+		return result;
+	}
+	args->tfa_start = (vaddr_t)start;
+	args->tfa_arg = arg;
+
+	result = thread_fork(curthread->t_name, curproc,
+			     threadfork_newthread, args, tid);
+	if (result) {
+		proc_unnewthread(tid);
+		kfree(args);
+		return result;
+	}
+
+	*retval = tid;
+	return 0;
+}
+
+/*
+ * sys_threadexit
+ */
+__DEAD
+void
+sys_threadexit(int status)
+{
+	proc_threadexit(status);
+}
+
+/*
+ * sys_threadjoin
+ */
+int
+sys_threadjoin(int tid, userptr_t retstatus)
+{
+	int status;
+	int result;
+
+	if (tid < 0) {
+		return EINVAL;
+	}
+	result = proc_threadjoin(tid, &status);
+	if (result) {
+		return result;
+	}
+
+	if (retstatus != NULL) {
+		result = copyout(&status, retstatus, sizeof(int));
+	}
+	return result;
+}
+
 /*
  * sys_waitpid
  * just pass off the work to the pid code.
@@ -36,6 +36,8 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <kern/unistd.h>
+#include <kern/wait.h>
+#include <kern/spawn.h>
 #include <limits.h>
 #include <lib.h>
 #include <proc.h>
@@ -47,6 +49,7 @@
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pid.h>
 #include <syscall.h>
 #include <test.h>
 
@@ -386,12 +389,13 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
         }
 
 	/*
-	 * Wipe out old address space.
+	 * Wipe out old address space, or if it was borrowed by vfork,
+	 * give it back to its owner.
 	 *
 	 * Note: once this is done, execv() must not fail, because there's
 	 * nothing left for it to return an error to.
 	 */
-	if (oldvm) {
+	if (!proc_vforkdone() && oldvm) {
 		as_destroy(oldvm);
 	}
 
@@ -406,6 +410,33 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 }
 
 
+/*
+ * Open a file on a selected file descriptor of file table FT,
+ * closing anything that was there. Calls vfs_open on PATH (via
+ * openfile_open) and thus may destroy it.
+ */
+static
+int
+placed_openat(struct filetable *ft, char *path, int openflags, int fd)
+{
+	struct openfile *newfile, *oldfile;
+	int result;
+
+	result = openfile_open(path, openflags, 0664, &newfile);
+	if (result) {
+		return result;
+	}
+
+	/* place the file in the filetable in the right slot */
+	filetable_placeat(ft, newfile, fd, &oldfile);
+
+	if (oldfile != NULL) {
+		openfile_decref(oldfile);
+	}
+
+	return 0;
+}
+
 /*
  * Open a file on a selected file descriptor. Takes care of various
  * minutiae, like the vfs-level open destroying pathnames.
@@ -414,9 +445,7 @@ static
 int
 placed_open(const char *path, int openflags, int fd)
 {
-	struct openfile *newfile, *oldfile;
 	char mypath[32];
-	int result;
 
 	/*
 	 * The filename comes from the kernel, in fact right in this
@@ -425,18 +454,7 @@ placed_open(const char *path, int openflags, int fd)
 	KASSERT(strlen(path) < sizeof(mypath));
 	strcpy(mypath, path);
 
-	result = openfile_open(mypath, openflags, 0664, &newfile);
-	if (result) {
-		return result;
-	}
-
-	/* place the file in the filetable in the right slot */
-	filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
-
-	/* the table should previously have been empty */
-	KASSERT(oldfile == NULL);
-
-	return 0;
+	return placed_openat(curproc->p_filetable, mypath, openflags, fd);
 }
 
 /*
@@ -560,6 +578,11 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	int argc;
 	int result;
 
+	/* The other threads would be left running in the old image. */
+	if (!proc_singlethreaded()) {
+		return EBUSY;
+	}
+
 	path = kmalloc(PATH_MAX);
 	if (!path) {
 		return ENOMEM;
@@ -594,6 +617,9 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	/* don't need this any more */
 	kfree(path);
 
+	/* Any thread stacks went with the old address space. */
+	proc_execreset();
+
 	/* Send the argv strings to the process. */
 	result = argbuf_copyout(&kargv, &stackptr, &argc, &uargv);
 	if (result) {
@@ -611,3 +637,248 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	panic("enter_new_process returned\n");
 	return EINVAL;
 }
+
+/*
+ * spawn.
+ *
+ * This is fork, some file descriptor juggling, and execv in one call,
+ * without the address space copy in between that the exec would
+ * throw away:
+ *
+ * 1. Copy in the program name, the argv, and the file actions.
+ * 2. Make a new process, with a copy of our file table.
+ * 3. Apply the file actions to the new file table.
+ * 4. Start a thread in the new process to load the executable and
+ *    go to usermode, and wait for it to say whether that worked.
+ *
+ * Waiting means all the usual exec errors (no such file, not an
+ * executable, etc.) come back to the caller, as does the pid if
+ * all is well. The wait is short; the new thread only has to load
+ * the program.
+ */
+
+struct spawninfo {
+	char *si_path;			/* Program name (may get trashed) */
+	struct argbuf si_args;		/* Its argv */
+	struct semaphore *si_done;	/* V'd when the load is done */
+	int si_result;			/* ... with this result */
+};
+
+/*
+ * Carry out one file action on the new process's file table FT.
+ * PATHBUF is PATH_MAX bytes of space for the pathname.
+ */
+static
+int
+spawn_fileaction(struct filetable *ft, const struct spawn_action *sa,
+		 char *pathbuf)
+{
+	const int allflags =
+		O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_APPEND | O_NOCTTY;
+	struct openfile *file, *oldfile;
+	int result;
+
+	if (!filetable_okfd(ft, sa->sa_fd)) {
+		return EBADF;
+	}
+
+	switch (sa->sa_op) {
+	    case SPAWN_OPEN:
+		if ((sa->sa_arg & allflags) != sa->sa_arg) {
+			return EINVAL;
+		}
+		result = copyinstr((const_userptr_t)sa->sa_path, pathbuf,
+				   PATH_MAX, NULL);
+		if (result) {
+			return result;
+		}
+		return placed_openat(ft, pathbuf, sa->sa_arg, sa->sa_fd);
+
+	    case SPAWN_DUP2:
+		result = filetable_get(ft, sa->sa_arg, &file);
+		if (result) {
+			return result;
+		}
+		if (sa->sa_arg == sa->sa_fd) {
+			/* as for dup2, nothing to do if it's open */
+			filetable_put(ft, sa->sa_arg, file);
+			return 0;
+		}
+		openfile_incref(file);
+		filetable_put(ft, sa->sa_arg, file);
+		filetable_placeat(ft, file, sa->sa_fd, &oldfile);
+		if (oldfile != NULL) {
+			openfile_decref(oldfile);
+		}
+		return 0;
+
+	    case SPAWN_CLOSE:
+		filetable_placeat(ft, NULL, sa->sa_fd, &oldfile);
+		if (oldfile == NULL) {
+			return EBADF;
+		}
+		openfile_decref(oldfile);
+		return 0;
+	}
+	return EINVAL;
+}
+
+/*
+ * The new process's thread.
+ */
+static
+void
+spawn_newthread(void *vsi, unsigned long unused)
+{
+	struct spawninfo *si = vsi;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	int argc;
+	int result;
+
+	(void)unused;
+
+	result = loadexec(si->si_path, &entrypoint, &stackptr);
+	if (result == 0) {
+		result = argbuf_copyout(&si->si_args, &stackptr, &argc,
+					&uargv);
+	}
+
+	/*
+	 * Only become visible to waitpid once we know we'll run; if
+	 * we fail, we exit still hidden and nobody sees us.
+	 */
+	if (result == 0) {
+		pid_unhide();
+	}
+
+	/* The spawner frees SI once it wakes up, so let go of it now. */
+	si->si_result = result;
+	V(si->si_done);
+
+	if (result) {
+		/* Nobody's going to look at the status; see pid_hide. */
+		proc_exit(_MKWAIT_EXIT(255));
+		thread_exit();
+	}
+
+	/* Warp to user mode. */
+	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
+
+	/* enter_new_process does not return. */
+	panic("enter_new_process returned\n");
+}
+
+int
+sys_spawn(userptr_t prog, userptr_t uargv, userptr_t uactions, int nactions,
+	  pid_t *retval)
+{
+	struct spawninfo si;
+	struct spawn_action *actions;
+	struct proc *newproc;
+	char *pathbuf;
+	pid_t pid;
+	int i, result;
+
+	if (nactions < 0 || nactions > SPAWN_MAXACTIONS) {
+		return EINVAL;
+	}
+
+	si.si_path = kmalloc(PATH_MAX);
+	if (si.si_path == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(prog, si.si_path, PATH_MAX, NULL);
+	if (result) {
+		kfree(si.si_path);
+		return result;
+	}
+
+	argbuf_init(&si.si_args);
+	result = argbuf_fromuser(&si.si_args, uargv);
+	if (result) {
+		goto fail_args;
+	}
+
+	/* Allocate at least one so kmalloc is happy. */
+	actions = kmalloc((nactions + 1) * sizeof(*actions));
+	if (actions == NULL) {
+		result = ENOMEM;
+		goto fail_args;
+	}
+	result = copyin(uactions, actions, nactions * sizeof(*actions));
+	if (result) {
+		goto fail_actions;
+	}
+
+	si.si_done = sem_create("spawn", 0);
+	if (si.si_done == NULL) {
+		result = ENOMEM;
+		goto fail_actions;
+	}
+
+	result = proc_create_runprogram(si.si_path, &newproc);
+	if (result) {
+		goto fail_sem;
+	}
+	pid = newproc->p_pid;
+
+	/*
+	 * Keep the child out of reach of waitpid (from our other
+	 * threads) until it has loaded, so a failed spawn never shows
+	 * up as a child.
+	 */
+	pid_hide(pid);
+
+	result = filetable_copy(curproc->p_filetable, &newproc->p_filetable);
+	if (result) {
+		goto fail_proc;
+	}
+
+	pathbuf = kmalloc(PATH_MAX);
+	if (pathbuf == NULL) {
+		result = ENOMEM;
+		goto fail_proc;
+	}
+	for (i=0; i<nactions; i++) {
+		result = spawn_fileaction(newproc->p_filetable, &actions[i],
+					  pathbuf);
+		if (result) {
+			break;
+		}
+	}
+	kfree(pathbuf);
+	if (result) {
+		goto fail_proc;
+	}
+
+	result = thread_fork(si.si_path /* thread name */, newproc,
+			     spawn_newthread, &si, 0);
+	if (result) {
+		goto fail_proc;
+	}
+
+	/* If the load failed, the child is exiting unseen. */
+	P(si.si_done);
+	result = si.si_result;
+	if (result == 0) {
+		*retval = pid;
+	}
+
+	sem_destroy(si.si_done);
+	kfree(actions);
+	argbuf_cleanup(&si.si_args);
+	kfree(si.si_path);
+	return result;
+
+ fail_proc:
+	proc_unfork(newproc);
+ fail_sem:
+	sem_destroy(si.si_done);
+ fail_actions:
+	kfree(actions);
+ fail_args:
+	argbuf_cleanup(&si.si_args);
+	kfree(si.si_path);
+	return result;
+}
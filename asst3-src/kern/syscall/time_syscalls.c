@@ -28,8 +28,16 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <lib.h>
 #include <clock.h>
 #include <copyinout.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <timeout.h>
 #include <syscall.h>
 
 /*
@@ -56,3 +64,97 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the requested time.
+ *
+ * We sleep for whole hardclock ticks, rounding up, plus one more
+ * since the current tick is already partly over; so we never return
+ * early, and with HZ at 100 may sleep up to 20ms too long. There are
+ * no signals, so we are never interrupted and the remaining time
+ * handed back is always zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req, rem;
+	uint64_t ticks;
+	int result;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	/* Clamp first so a huge tv_sec can't wrap into a short sleep. */
+	if (req.tv_sec >= (unsigned)-1 / HZ) {
+		ticks = (unsigned)-1;
+	}
+	else {
+		ticks = (uint64_t)req.tv_sec * HZ +
+			((uint64_t)req.tv_nsec * HZ + 999999999) / 1000000000;
+	}
+	if (ticks > 0) {
+		if (ticks >= (unsigned)-1) {
+			/* about 497 days; that will have to do */
+			ticks = (unsigned)-1 - 1;
+		}
+		timeout_sleep(ticks + 1);
+	}
+
+	if (user_rem != NULL) {
+		rem.tv_sec = 0;
+		rem.tv_nsec = 0;
+		result = copyout(&rem, user_rem, sizeof(rem));
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Convert a tick count to a timeval.
+ */
+static
+void
+ticks_to_timeval(unsigned ticks, struct timeval *tv)
+{
+	tv->tv_sec = ticks / HZ;
+	tv->tv_usec = (ticks % HZ) * (1000000 / HZ);
+}
+
+/*
+ * Get resource usage, for the current process or its collected
+ * children. We only keep CPU time and context switches (see struct
+ * threadstats); the rest reads as zero. Times are sampled at each
+ * hardclock, so they have tick resolution.
+ */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+	struct threadstats ts;
+	struct rusage ru;
+
+	switch (who) {
+	    case RUSAGE_SELF:
+		proc_getstats(curproc, false, &ts);
+		break;
+	    case RUSAGE_CHILDREN:
+		proc_getstats(curproc, true, &ts);
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	bzero(&ru, sizeof(ru));
+	ticks_to_timeval(ts.ts_uticks, &ru.ru_utime);
+	ticks_to_timeval(ts.ts_sticks, &ru.ru_stime);
+	ru.ru_nvcsw = ts.ts_nvcsw;
+	ru.ru_nivcsw = ts.ts_nivcsw;
+
+	return copyout(&ru, usage, sizeof(ru));
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Real-time scheduling test.
+ *
+ * A periodic thread sleeps for RTPERIOD ticks at a time while NHOGS
+ * compute-bound threads try to keep every cpu busy, and we measure how
+ * late it wakes up. This is done once with the periodic thread in
+ * SCHED_OTHER, for comparison, and once in SCHED_FIFO, where it should
+ * never miss a period.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <timeout.h>
+#include <test.h>
+
+#define NHOGS		16
+#define RTPERIOD	5	/* ticks */
+#define RTLOOPS		100
+
+static struct semaphore *rtdonesem;
+static volatile bool rtstop;
+static uint64_t rtmaxlate;
+static unsigned rtmissed;
+
+static
+void
+rthog(void *junk, unsigned long num)
+{
+	volatile unsigned long x = num;
+
+	(void)junk;
+
+	while (!rtstop) {
+		x = x * 1103515245 + 12345;
+	}
+	V(rtdonesem);
+}
+
+static
+void
+rtperiodic(void *junk, unsigned long policy)
+{
+	struct timespec before, after, diff;
+	uint64_t ns, late, period;
+	unsigned i;
+	int result;
+
+	(void)junk;
+
+	result = thread_setsched(policy, 0);
+	if (result) {
+		panic("rttest: thread_setsched: %s\n", strerror(result));
+	}
+
+	period = RTPERIOD * (1000000000ULL / HZ);
+	rtmaxlate = 0;
+	rtmissed = 0;
+
+	for (i=0; i<RTLOOPS; i++) {
+		gettime(&before);
+		timeout_sleep(RTPERIOD);
+		gettime(&after);
+
+		timespec_sub(&after, &before, &diff);
+		ns = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+		late = ns > period ? ns - period : 0;
+		if (late > rtmaxlate) {
+			rtmaxlate = late;
+		}
+		if (late >= period) {
+			rtmissed++;
+		}
+	}
+	V(rtdonesem);
+}
+
+static
+void
+rtrun(int policy, const char *name)
+{
+	int i, result;
+
+	rtstop = false;
+	for (i=0; i<NHOGS; i++) {
+		result = thread_fork("rthog", NULL, rthog, NULL, i);
+		if (result) {
+			panic("rttest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	result = thread_fork("rtperiodic", NULL, rtperiodic, NULL, policy);
+	if (result) {
+		panic("rttest: thread_fork failed: %s\n", strerror(result));
+	}
+
+	P(rtdonesem);
+	rtstop = true;
+	for (i=0; i<NHOGS; i++) {
+		P(rtdonesem);
+	}
+
+	kprintf("%s: %u periods, %u missed, max lateness %llu us\n",
+		name, RTLOOPS, rtmissed,
+		(unsigned long long)(rtmaxlate / 1000));
+}
+
+int
+rttest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	if (rtdonesem == NULL) {
+		rtdonesem = sem_create("rtdonesem", 0);
+		if (rtdonesem == NULL) {
+			panic("rttest: sem_create failed\n");
+		}
+	}
+
+	kprintf("Starting real-time scheduling test...\n");
+	rtrun(SCHED_OTHER, "SCHED_OTHER");
+	rtrun(SCHED_FIFO, "SCHED_FIFO");
+	kprintf("Real-time scheduling test %s.\n",
+		rtmissed == 0 ? "done" : "FAILED");
+
+	return 0;
+}
@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Scheduler and locking microbenchmarks.
+ *
+ * These measure rather than test: each prints timings taken with
+ * gettime, so changes to the scheduler or to synchronization can be
+ * compared by running them before and after. Reading the clock takes
+ * a while on System/161, so where something is timed one event at a
+ * time the cost of a clock read is printed alongside for reference.
+ *
+ *    bm1 - context switch: two threads on one cpu ping-pong through
+ *          a pair of semaphores.
+ *    bm2 - wakeup-to-run latency: time from V() to the sleeping
+ *          thread running, both on one cpu.
+ *    bm3 - the same, with the waker and sleeper on different cpus.
+ *    bm4 - thread_fork and thread exit/exorcise: one thread at a
+ *          time, and in a burst.
+ *    bm5 - lock_acquire/lock_release pairs, uncontended and with one
+ *          thread per cpu fighting over the lock.
+ *    bm  - all of the above.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <synch.h>
+#include <wchan.h>
+#include <test.h>
+
+#define BM_SWITCHES	5000
+#define BM_WAKEUPS	1000
+#define BM_FORKS	500
+#define BM_LOCKS	20000
+#define BM_CLOCKREADS	1000
+
+static struct semaphore *bm_done;
+static struct semaphore *bm_ping;
+static struct semaphore *bm_pong;
+static struct lock *bm_lock;
+
+static struct spinlock bm_statlock = SPINLOCK_INITIALIZER;
+static struct timespec bm_stamp;
+static uint64_t bm_total, bm_max;
+static volatile unsigned bm_ready;
+static volatile bool bm_go;
+static volatile unsigned long bm_counter;
+
+static
+void
+bm_init(void)
+{
+	if (bm_done == NULL) {
+		bm_done = sem_create("bm_done", 0);
+		bm_ping = sem_create("bm_ping", 0);
+		bm_pong = sem_create("bm_pong", 0);
+		bm_lock = lock_create("bm_lock");
+		if (bm_done == NULL || bm_ping == NULL ||
+		    bm_pong == NULL || bm_lock == NULL) {
+			panic("schedbench: Out of memory\n");
+		}
+	}
+	bm_total = bm_max = 0;
+	bm_ready = 0;
+	bm_go = false;
+	bm_counter = 0;
+}
+
+static
+uint64_t
+bm_ns(const struct timespec *start, const struct timespec *end)
+{
+	struct timespec diff;
+
+	timespec_sub(end, start, &diff);
+	return diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+}
+
+static
+void
+bm_fork(const char *name, void (*func)(void *, unsigned long),
+	unsigned long num)
+{
+	int result;
+
+	result = thread_fork(name, NULL, func, NULL, num);
+	if (result) {
+		panic("schedbench: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+}
+
+static
+void
+bm_pin(unsigned cpunum)
+{
+	int result;
+
+	result = thread_setaffinity((uint32_t)1 << cpunum);
+	if (result) {
+		panic("schedbench: cannot run on cpu %u\n", cpunum);
+	}
+}
+
+/*
+ * Average cost of one gettime call.
+ */
+static
+uint64_t
+bm_clockcost(void)
+{
+	struct timespec start, end, junk;
+	unsigned i;
+
+	gettime(&start);
+	for (i=0; i<BM_CLOCKREADS; i++) {
+		gettime(&junk);
+	}
+	gettime(&end);
+	return bm_ns(&start, &end) / BM_CLOCKREADS;
+}
+
+////////////////////////////////////////////////////////////
+// bm1: context switch
+
+static
+void
+bm_switchthread(void *junk, unsigned long which)
+{
+	struct timespec start, end;
+	unsigned i;
+
+	(void)junk;
+
+	bm_pin(0);
+
+	if (which == 0) {
+		/* One round to make sure the other thread is going. */
+		V(bm_ping);
+		P(bm_pong);
+
+		gettime(&start);
+		for (i=0; i<BM_SWITCHES; i++) {
+			V(bm_ping);
+			P(bm_pong);
+		}
+		gettime(&end);
+		bm_total = bm_ns(&start, &end);
+	}
+	else {
+		for (i=0; i<BM_SWITCHES + 1; i++) {
+			P(bm_ping);
+			V(bm_pong);
+		}
+	}
+	V(bm_done);
+}
+
+int
+ctxswbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	bm_init();
+	kprintf("Starting context switch benchmark...\n");
+
+	bm_fork("bm_switch", bm_switchthread, 0);
+	bm_fork("bm_switch", bm_switchthread, 1);
+	P(bm_done);
+	P(bm_done);
+
+	kprintf("%u switches in %llu us: %llu ns per switch\n",
+		2 * BM_SWITCHES,
+		(unsigned long long)(bm_total / 1000),
+		(unsigned long long)(bm_total / (2 * BM_SWITCHES)));
+	kprintf("Context switch benchmark done.\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// bm2, bm3: wakeup latency
+
+/*
+ * Wait until some thread is asleep on SEM.
+ */
+static
+void
+bm_waitsleeper(struct semaphore *sem)
+{
+	bool empty;
+
+	while (1) {
+		spinlock_acquire(&sem->sem_lock);
+		empty = wchan_isempty(sem->sem_wchan, &sem->sem_lock);
+		spinlock_release(&sem->sem_lock);
+		if (!empty) {
+			return;
+		}
+		thread_yield();
+	}
+}
+
+static
+void
+bm_sleeperthread(void *junk, unsigned long cpunum)
+{
+	struct timespec now;
+	uint64_t ns;
+	unsigned i;
+
+	(void)junk;
+
+	bm_pin(cpunum);
+	for (i=0; i<BM_WAKEUPS; i++) {
+		P(bm_ping);
+		gettime(&now);
+		ns = bm_ns(&bm_stamp, &now);
+		bm_total += ns;
+		if (ns > bm_max) {
+			bm_max = ns;
+		}
+		V(bm_pong);
+	}
+	V(bm_done);
+}
+
+static
+void
+bm_wakerthread(void *junk, unsigned long cpunum)
+{
+	unsigned i;
+
+	(void)junk;
+
+	bm_pin(cpunum);
+	for (i=0; i<BM_WAKEUPS; i++) {
+		bm_waitsleeper(bm_ping);
+		gettime(&bm_stamp);
+		V(bm_ping);
+		P(bm_pong);
+	}
+	V(bm_done);
+}
+
+static
+void
+bm_wakeup(unsigned wakercpu, unsigned sleepercpu)
+{
+	uint64_t clockcost;
+
+	bm_init();
+	clockcost = bm_clockcost();
+
+	bm_fork("bm_sleeper", bm_sleeperthread, sleepercpu);
+	bm_fork("bm_waker", bm_wakerthread, wakercpu);
+	P(bm_done);
+	P(bm_done);
+
+	kprintf("%u wakeups: average %llu ns, max %llu ns "
+		"(clock read %llu ns)\n", BM_WAKEUPS,
+		(unsigned long long)(bm_total / BM_WAKEUPS),
+		(unsigned long long)bm_max,
+		(unsigned long long)clockcost);
+}
+
+int
+wakebench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting wakeup latency benchmark...\n");
+	bm_wakeup(0, 0);
+	kprintf("Wakeup latency benchmark done.\n");
+	return 0;
+}
+
+int
+xcpuwakebench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	if (cpu_count() < 2) {
+		kprintf("Cross-cpu wakeup benchmark needs 2 cpus\n");
+		return 0;
+	}
+	kprintf("Starting cross-cpu wakeup benchmark...\n");
+	bm_wakeup(0, 1);
+	kprintf("Cross-cpu wakeup benchmark done.\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// bm4: thread_fork and exit
+
+static
+void
+bm_forkthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(bm_done);
+}
+
+int
+forkbench(int nargs, char **args)
+{
+	struct timespec start, end;
+	uint64_t serial, burst;
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	bm_init();
+	kprintf("Starting thread fork benchmark...\n");
+
+	/* One at a time: fork, run, exit, and get reaped. */
+	gettime(&start);
+	for (i=0; i<BM_FORKS; i++) {
+		bm_fork("bm_fork", bm_forkthread, i);
+		P(bm_done);
+	}
+	gettime(&end);
+	serial = bm_ns(&start, &end);
+
+	/* All at once. */
+	gettime(&start);
+	for (i=0; i<BM_FORKS; i++) {
+		bm_fork("bm_fork", bm_forkthread, i);
+	}
+	for (i=0; i<BM_FORKS; i++) {
+		P(bm_done);
+	}
+	gettime(&end);
+	burst = bm_ns(&start, &end);
+
+	kprintf("one at a time: %u threads in %llu us, %llu ns each\n",
+		BM_FORKS, (unsigned long long)(serial / 1000),
+		(unsigned long long)(serial / BM_FORKS));
+	kprintf("burst: %u threads in %llu us, %llu ns each\n",
+		BM_FORKS, (unsigned long long)(burst / 1000),
+		(unsigned long long)(burst / BM_FORKS));
+	kprintf("Thread fork benchmark done.\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// bm5: locks
+
+static
+void
+bm_lockthread(void *junk, unsigned long cpunum)
+{
+	unsigned i, nloops;
+
+	(void)junk;
+
+	bm_pin(cpunum);
+	nloops = BM_LOCKS / cpu_count();
+
+	spinlock_acquire(&bm_statlock);
+	bm_ready++;
+	spinlock_release(&bm_statlock);
+	while (!bm_go) {
+		thread_yield();
+	}
+
+	for (i=0; i<nloops; i++) {
+		lock_acquire(bm_lock);
+		bm_counter++;
+		lock_release(bm_lock);
+	}
+	V(bm_done);
+}
+
+int
+lockbench(int nargs, char **args)
+{
+	struct timespec start, end;
+	uint64_t ns;
+	unsigned i, ncpus;
+
+	(void)nargs;
+	(void)args;
+
+	bm_init();
+	kprintf("Starting lock benchmark...\n");
+
+	gettime(&start);
+	for (i=0; i<BM_LOCKS; i++) {
+		lock_acquire(bm_lock);
+		bm_counter++;
+		lock_release(bm_lock);
+	}
+	gettime(&end);
+	ns = bm_ns(&start, &end);
+	kprintf("uncontended: %u acquire/release pairs, %llu ns each\n",
+		BM_LOCKS, (unsigned long long)(ns / BM_LOCKS));
+
+	bm_counter = 0;
+	ncpus = cpu_count();
+	for (i=0; i<ncpus; i++) {
+		bm_fork("bm_lock", bm_lockthread, i);
+	}
+	while (bm_ready < ncpus) {
+		thread_yield();
+	}
+	gettime(&start);
+	bm_go = true;
+	for (i=0; i<ncpus; i++) {
+		P(bm_done);
+	}
+	gettime(&end);
+	ns = bm_ns(&start, &end);
+
+	if (bm_counter != (BM_LOCKS / ncpus) * ncpus) {
+		panic("lockbench: counter %lu, expected %u\n", bm_counter,
+		      (BM_LOCKS / ncpus) * ncpus);
+	}
+	kprintf("contended: %u cpus, %lu pairs in %llu us, %llu ns each\n",
+		ncpus, bm_counter, (unsigned long long)(ns / 1000),
+		(unsigned long long)(ns / bm_counter));
+	kprintf("Lock benchmark done.\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// bm: everything
+
+int
+schedbench(int nargs, char **args)
+{
+	ctxswbench(nargs, args);
+	wakebench(nargs, args);
+	xcpuwakebench(nargs, args);
+	forkbench(nargs, args);
+	lockbench(nargs, args);
+	return 0;
+}
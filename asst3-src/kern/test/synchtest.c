@@ -35,6 +35,7 @@
 #include <kern/wait.h>
 #include <lib.h>
 #include <clock.h>
+#include <spinlock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
@@ -400,3 +401,315 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+/*
+ * Lock latency test: NTHREADS threads hammer one lock with short
+ * critical sections, and we report how long lock_acquire took under
+ * contention.
+ */
+
+#define NLATLOOPS 200
+static uint64_t lat_total[NTHREADS];
+static uint64_t lat_max[NTHREADS];
+
+static
+void
+locklatthread(void *junk, unsigned long num)
+{
+	struct timespec before, after, diff;
+	uint64_t ns;
+	unsigned i;
+
+	(void)junk;
+
+	lat_total[num] = 0;
+	lat_max[num] = 0;
+
+	for (i=0; i<NLATLOOPS; i++) {
+		gettime(&before);
+		lock_acquire(testlock);
+		gettime(&after);
+
+		testval1 = num;
+		if (testval1 != num) {
+			fail(num, "testval1/num");
+		}
+		lock_release(testlock);
+
+		timespec_sub(&after, &before, &diff);
+		ns = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+		lat_total[num] += ns;
+		if (ns > lat_max[num]) {
+			lat_max[num] = ns;
+		}
+	}
+	V(donesem);
+}
+
+int
+locklattest(int nargs, char **args)
+{
+	uint64_t total, max;
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting lock latency test...\n");
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("synchtest", NULL, locklatthread,
+				     NULL, i);
+		if (result) {
+			panic("locklattest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	total = max = 0;
+	for (i=0; i<NTHREADS; i++) {
+		total += lat_total[i];
+		if (lat_max[i] > max) {
+			max = lat_max[i];
+		}
+	}
+	kprintf("%u acquires: average %llu ns, max %llu ns\n",
+		NTHREADS * NLATLOOPS,
+		(unsigned long long)(total / (NTHREADS * NLATLOOPS)),
+		(unsigned long long)max);
+	kprintf("Lock latency test done.\n");
+
+	return 0;
+}
+
+/*
+ * Reader-writer lock stress test. A quarter of the threads write,
+ * changing the test values together; the rest read and check that
+ * they never see a half-done update or a writer alongside them.
+ */
+
+#define NRWLOOPS 100
+static struct rwlock *testrwlock;
+static struct spinlock rwstatlock = SPINLOCK_INITIALIZER;
+static volatile unsigned rwreaders;
+static volatile bool rwwriting;
+static unsigned rwmaxreaders;
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	unsigned long val;
+	unsigned i;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % 4 == 0) {
+			rwlock_acquire_write(testrwlock);
+			if (rwwriting || rwreaders > 0) {
+				fail(num, "writer not alone");
+			}
+			rwwriting = true;
+			testval1 = num;
+			thread_yield();
+			testval2 = num*num;
+			testval3 = num%3;
+			rwwriting = false;
+			rwlock_release_write(testrwlock);
+		}
+		else {
+			rwlock_acquire_read(testrwlock);
+			spinlock_acquire(&rwstatlock);
+			rwreaders++;
+			if (rwreaders > rwmaxreaders) {
+				rwmaxreaders = rwreaders;
+			}
+			spinlock_release(&rwstatlock);
+
+			if (rwwriting) {
+				fail(num, "reader alongside writer");
+			}
+			val = testval1;
+			thread_yield();
+			if (testval2 != val*val) {
+				fail(num, "testval2/testval1");
+			}
+			if (testval3 != val%3) {
+				fail(num, "testval3/testval1");
+			}
+
+			spinlock_acquire(&rwstatlock);
+			rwreaders--;
+			spinlock_release(&rwstatlock);
+			rwlock_release_read(testrwlock);
+		}
+	}
+	V(donesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrwlock = rwlock_create("testrwlock");
+	if (testrwlock == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	testval1 = testval2 = testval3 = 0;
+	rwreaders = 0;
+	rwwriting = false;
+	rwmaxreaders = 0;
+
+	kprintf("Starting rwlock test...\n");
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("synchtest", NULL, rwtestthread,
+				     NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	rwlock_destroy(testrwlock);
+	testrwlock = NULL;
+
+	kprintf("Up to %u concurrent readers\n", rwmaxreaders);
+	kprintf("Rwlock test done.\n");
+
+	return 0;
+}
+
+/*
+ * Spinlock contention benchmark. One thread is pinned to each cpu and
+ * all of them hammer the same spinlock with a short critical section.
+ * We report the aggregate acquisition rate and the longest any cpu
+ * waited for the lock.
+ */
+
+#define NSPLOOPS	10000
+#define NSPTHREADS	32	/* one per possible cpu */
+static struct spinlock splcontended = SPINLOCK_INITIALIZER;
+static struct spinlock splstatlock = SPINLOCK_INITIALIZER;
+static volatile unsigned splready, splabsent;
+static volatile bool splgo;
+static volatile unsigned long splcount;
+static uint64_t splmaxwait;
+
+static
+void
+splbenchthread(void *junk, unsigned long num)
+{
+	struct timespec before, after, diff;
+	uint64_t ns, maxwait;
+	unsigned i;
+
+	(void)junk;
+
+	if (thread_setaffinity((uint32_t)1 << num)) {
+		/* No such cpu */
+		spinlock_acquire(&splstatlock);
+		splabsent++;
+		spinlock_release(&splstatlock);
+		V(donesem);
+		return;
+	}
+
+	spinlock_acquire(&splstatlock);
+	splready++;
+	spinlock_release(&splstatlock);
+	while (!splgo) {
+		thread_yield();
+	}
+
+	maxwait = 0;
+	for (i=0; i<NSPLOOPS; i++) {
+		gettime(&before);
+		spinlock_acquire(&splcontended);
+		gettime(&after);
+		splcount++;
+		spinlock_release(&splcontended);
+
+		timespec_sub(&after, &before, &diff);
+		ns = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+		if (ns > maxwait) {
+			maxwait = ns;
+		}
+	}
+
+	spinlock_acquire(&splstatlock);
+	if (maxwait > splmaxwait) {
+		splmaxwait = maxwait;
+	}
+	spinlock_release(&splstatlock);
+	V(donesem);
+}
+
+int
+spinlockbench(int nargs, char **args)
+{
+	struct timespec start, end, diff;
+	uint64_t ns;
+	unsigned ncpus;
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	splready = splabsent = 0;
+	splgo = false;
+	splcount = 0;
+	splmaxwait = 0;
+
+	kprintf("Starting spinlock contention benchmark...\n");
+
+	for (i=0; i<NSPTHREADS; i++) {
+		result = thread_fork("synchtest", NULL, splbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("spinlockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	while (splready + splabsent < NSPTHREADS) {
+		thread_yield();
+	}
+	ncpus = splready;
+
+	gettime(&start);
+	splgo = true;
+	for (i=0; i<NSPTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&end);
+
+	if (splcount != ncpus * NSPLOOPS) {
+		panic("spinlockbench: %lu acquisitions, expected %u\n",
+		      splcount, ncpus * NSPLOOPS);
+	}
+
+	timespec_sub(&end, &start, &diff);
+	ns = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+	kprintf("%u cpus, %lu acquisitions in %llu us: %llu/sec, "
+		"max wait %llu ns\n", ncpus, splcount,
+		(unsigned long long)(ns / 1000),
+		(unsigned long long)(splcount * 1000000000ULL / (ns ? ns : 1)),
+		(unsigned long long)splmaxwait);
+	kprintf("Spinlock contention benchmark done.\n");
+
+	return 0;
+}
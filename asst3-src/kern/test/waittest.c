@@ -31,6 +31,7 @@
  * Wait test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <kern/wait.h>
 #include <lib.h>
 #include <stdarg.h>
@@ -257,6 +258,36 @@ waittest(int nargs, char **args)
 		printstatus(kid, err, status);
 	}
 
+	/*
+	 * This fourth set is collected with WAIT_ANY, which should
+	 * return each child as it exits (roughly in order, as the
+	 * later ones spin longer), and then fail with ECHILD.
+	 */
+
+	kprintf("\n");
+	kprintf("Set 4 (wait for any child)\n");
+	kprintf("--------------------------\n");
+
+	for (i = 0; i < NTHREADS; i++) {
+		err = dofork("wait test thread", waitfirstthread, NULL, i,
+			     &kid);
+		if (err) {
+			panic("waittest: dofork failed (%d)\n", err);
+		}
+		kprintf("Spawned pid %d\n", kid);
+	}
+
+	for (i = 0; i < NTHREADS; i++) {
+		kprintf("Waiting for any child...\n");
+		err = pid_wait(WAIT_ANY, &status, 0, &kid);
+		printstatus(kid, err, status);
+	}
+	err = pid_wait(WAIT_ANY, &status, 0, &kid);
+	if (err != ECHILD) {
+		panic("waittest: wait with no children returned %d\n", err);
+	}
+	kprintf("No children left.\n");
+
 	kprintf("\nWait test done.\n");
 
 	return 0;
@@ -34,13 +34,16 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <mainbus.h>
+#include <timeout.h>
+#include <rcu.h>
+#include <prof.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Callbacks at specific points in the future, with one-tick
+ * resolution, are handled by timeout.c; hardclock drives it.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -50,7 +53,7 @@
  * Timing constants. These should be tuned along with any work done on
  * the scheduler.
  */
-#define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
+#define SCHEDULE_HARDCLOCKS	50	/* Reschedule every 50 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
@@ -70,6 +73,7 @@ hardclock_bootstrap(void)
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+	timeout_bootstrap();
 }
 
 /*
@@ -92,18 +96,106 @@ timerclock(void)
 void
 hardclock(void)
 {
+	struct cpustats *cs = &curcpu->c_stats;
+
 	/*
-	 * Collect statistics here as desired.
+	 * Collect statistics. The tick is charged to whatever was
+	 * interrupted; the run queue length is read without the lock
+	 * since it is only a sample.
 	 */
+	if (curcpu->c_isidle) {
+		cs->cs_idleticks++;
+	}
+	else {
+		cs->cs_busyticks++;
+		if (curcpu->c_intr_user) {
+			curthread->t_stats.ts_uticks++;
+		}
+		else {
+			curthread->t_stats.ts_sticks++;
+		}
+	}
+	cs->cs_rqsum += curcpu->c_runqueue.tl_count;
+	cs->cs_rqsamples++;
+	if (prof_running) {
+		prof_sample();
+	}
 
 	curcpu->c_hardclocks++;
+	/* We interrupted something, so it wasn't an RCU read section. */
+	rcu_quiescent();
+	timeout_hardclock();
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	thread_yield();
+	thread_tick();
+}
+
+/*
+ * Tickless idle.
+ *
+ * An idle cpu has no use for hardclock except to run timeouts (the
+ * scheduling work it does only matters for a cpu with something to
+ * run) so before idling we stretch the timer interval to reach the
+ * next point where the timeout wheel needs attention, at most
+ * MAINBUS_TIMER_MAXTICKS away. When the cpu is woken up, by the timer
+ * or by anything else, we account for the hardclocks that were
+ * skipped by running the wheel forward over them.
+ */
+void
+hardclock_idle_enter(void)
+{
+	unsigned ticks;
+
+	KASSERT(curcpu->c_idleticks == 0);
+
+	ticks = timeout_nextdue(MAINBUS_TIMER_MAXTICKS);
+	if (ticks <= 1) {
+		return;
+	}
+	gettime(&curcpu->c_idlestart);
+	curcpu->c_idleticks = ticks;
+	mainbus_settimer(ticks);
+}
+
+void
+hardclock_idle_exit(bool timer)
+{
+	struct timespec now, diff;
+	unsigned ticks, elapsed, i;
+
+	ticks = curcpu->c_idleticks;
+	if (ticks == 0) {
+		return;
+	}
+	curcpu->c_idleticks = 0;
+
+	if (timer) {
+		/* The hardclock that is about to run is the last tick. */
+		ticks--;
+	}
+	else {
+		/*
+		 * Woken early; work out how far we got, and go back to
+		 * ticking every period. Any partial period is lost.
+		 */
+		gettime(&now);
+		timespec_sub(&now, &curcpu->c_idlestart, &diff);
+		elapsed = diff.tv_sec * HZ + diff.tv_nsec / (1000000000 / HZ);
+		if (elapsed < ticks) {
+			ticks = elapsed;
+		}
+		mainbus_settimer(1);
+	}
+
+	curcpu->c_stats.cs_idleticks += ticks;
+	for (i=0; i<ticks; i++) {
+		curcpu->c_hardclocks++;
+		timeout_hardclock();
+	}
 }
 
 /*
@@ -112,10 +204,7 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-	spinlock_acquire(&lbolt_lock);
-	while (num_secs > 0) {
-		wchan_sleep(lbolt, &lbolt_lock);
-		num_secs--;
+	if (num_secs > 0) {
+		timeout_sleep(num_secs * HZ);
 	}
-	spinlock_release(&lbolt_lock);
 }
@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Lock contention statistics.
+ */
+
+#include <types.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <clock.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_NAMELEN	24
+#define LOCKSTAT_NCLASSES	256	/* must be a power of 2 */
+
+/*
+ * One of these per class. The counters are protected by lc_lock,
+ * which is a bare spin word rather than a struct spinlock so that
+ * taking it doesn't come back through the hooks. Slots are claimed
+ * under lockstat_tablelock and never released; lc_used is set last,
+ * so lookups can run without the table lock.
+ */
+struct lockstat_class {
+	volatile bool lc_used;
+	char lc_name[LOCKSTAT_NAMELEN];
+	const void *lc_caller;
+	volatile spinlock_data_t lc_lock;
+	uint64_t lc_acquires;
+	uint64_t lc_contended;
+	uint64_t lc_waitns;
+	uint64_t lc_maxwaitns;
+	uint64_t lc_holdns;
+	uint64_t lc_maxholdns;
+};
+
+static struct lockstat_class lockstat_table[LOCKSTAT_NCLASSES];
+static volatile spinlock_data_t lockstat_tablelock = SPINLOCK_DATA_INITIALIZER;
+
+/* Used when the table fills up. */
+static struct lockstat_class lockstat_overflow = {
+	.lc_used = true,
+	.lc_name = "(overflow)",
+};
+
+/* False until the clock exists. */
+static volatile bool lockstat_running;
+
+static
+void
+lockstat_lock(volatile spinlock_data_t *sd)
+{
+	while (spinlock_data_get(sd) != 0 ||
+	       spinlock_data_testandset(sd) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+}
+
+static
+void
+lockstat_unlock(volatile spinlock_data_t *sd)
+{
+	membar_any_store();
+	spinlock_data_set(sd, 0);
+}
+
+static
+uint64_t
+lockstat_now(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static
+unsigned
+lockstat_hash(const char *name, const void *caller)
+{
+	unsigned h;
+
+	h = (unsigned)(uintptr_t)caller >> 2;
+	while (*name) {
+		h = h * 33 + (unsigned char)*name++;
+	}
+	return h;
+}
+
+/*
+ * Names are kept truncated to LOCKSTAT_NAMELEN-1 characters.
+ */
+static
+bool
+lockstat_match(struct lockstat_class *lc, const char *name,
+	       const void *caller)
+{
+	unsigned i;
+
+	if (lc->lc_caller != caller) {
+		return false;
+	}
+	for (i=0; i<LOCKSTAT_NAMELEN-1; i++) {
+		if (lc->lc_name[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == 0) {
+			break;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find or make the class for NAME and CALLER.
+ */
+static
+struct lockstat_class *
+lockstat_lookup(const char *name, const void *caller)
+{
+	struct lockstat_class *lc;
+	unsigned h, i, j, slot;
+
+	h = lockstat_hash(name, caller);
+
+	/* Fast path: look without the table lock. */
+	for (i=0; i<LOCKSTAT_NCLASSES; i++) {
+		lc = &lockstat_table[(h + i) & (LOCKSTAT_NCLASSES - 1)];
+		if (!lc->lc_used) {
+			break;
+		}
+		membar_load_load();
+		if (lockstat_match(lc, name, caller)) {
+			return lc;
+		}
+	}
+
+	lockstat_lock(&lockstat_tablelock);
+	for (i=0; i<LOCKSTAT_NCLASSES; i++) {
+		slot = (h + i) & (LOCKSTAT_NCLASSES - 1);
+		lc = &lockstat_table[slot];
+		if (!lc->lc_used) {
+			for (j=0; j<LOCKSTAT_NAMELEN-1 && name[j]; j++) {
+				lc->lc_name[j] = name[j];
+			}
+			lc->lc_name[j] = 0;
+			lc->lc_caller = caller;
+			spinlock_data_set(&lc->lc_lock, 0);
+			membar_store_store();
+			lc->lc_used = true;
+			lockstat_unlock(&lockstat_tablelock);
+			return lc;
+		}
+		if (lockstat_match(lc, name, caller)) {
+			lockstat_unlock(&lockstat_tablelock);
+			return lc;
+		}
+	}
+	lockstat_unlock(&lockstat_tablelock);
+	return &lockstat_overflow;
+}
+
+////////////////////////////////////////////////////////////
+// Hooks
+
+/*
+ * Note that A is about to wait for a lock.
+ */
+void
+lockstat_wait(struct lockstat_actor *a)
+{
+	if (!lockstat_running) {
+		return;
+	}
+	a->a_waitstart = lockstat_now();
+}
+
+/*
+ * Note that A has acquired L. CONTENDED is true if it had to wait for
+ * someone else to let go of it first.
+ */
+void
+lockstat_acquire(struct lockstat_actor *a, struct lockstat_lockable *l,
+		 bool contended, const void *caller)
+{
+	struct lockstat_class *lc;
+	uint64_t now, wait;
+
+	l->l_holdclass = NULL;
+	if (!lockstat_running || a->a_waitstart == 0) {
+		return;
+	}
+
+	if (l->l_name != NULL) {
+		lc = l->l_class;
+		if (lc == NULL) {
+			lc = lockstat_lookup(l->l_name, NULL);
+			l->l_class = lc;
+		}
+	}
+	else {
+		lc = lockstat_lookup("spinlock", caller);
+	}
+
+	now = lockstat_now();
+	wait = now - a->a_waitstart;
+	a->a_waitstart = 0;
+
+	lockstat_lock(&lc->lc_lock);
+	lc->lc_acquires++;
+	if (contended) {
+		lc->lc_contended++;
+	}
+	lc->lc_waitns += wait;
+	if (wait > lc->lc_maxwaitns) {
+		lc->lc_maxwaitns = wait;
+	}
+	lockstat_unlock(&lc->lc_lock);
+
+	l->l_holdstart = now;
+	l->l_holdclass = lc;
+}
+
+/*
+ * Note that L is being released.
+ */
+void
+lockstat_release(struct lockstat_lockable *l)
+{
+	struct lockstat_class *lc;
+	uint64_t hold;
+
+	lc = l->l_holdclass;
+	if (lc == NULL) {
+		return;
+	}
+	l->l_holdclass = NULL;
+
+	hold = lockstat_now() - l->l_holdstart;
+
+	lockstat_lock(&lc->lc_lock);
+	lc->lc_holdns += hold;
+	if (hold > lc->lc_maxholdns) {
+		lc->lc_maxholdns = hold;
+	}
+	lockstat_unlock(&lc->lc_lock);
+}
+
+////////////////////////////////////////////////////////////
+// Control
+
+/*
+ * Start collecting. Must not be called until the clock device has
+ * been attached.
+ */
+void
+lockstat_bootstrap(void)
+{
+	lockstat_running = true;
+}
+
+static
+void
+lockstat_clear(struct lockstat_class *lc)
+{
+	lockstat_lock(&lc->lc_lock);
+	lc->lc_acquires = 0;
+	lc->lc_contended = 0;
+	lc->lc_waitns = 0;
+	lc->lc_maxwaitns = 0;
+	lc->lc_holdns = 0;
+	lc->lc_maxholdns = 0;
+	lockstat_unlock(&lc->lc_lock);
+}
+
+void
+lockstat_reset(void)
+{
+	unsigned i;
+	int spl;
+
+	spl = splhigh();
+	for (i=0; i<LOCKSTAT_NCLASSES; i++) {
+		if (lockstat_table[i].lc_used) {
+			lockstat_clear(&lockstat_table[i]);
+		}
+	}
+	lockstat_clear(&lockstat_overflow);
+	splx(spl);
+}
+
+static
+void
+lockstat_print(struct lockstat_class *lc)
+{
+	struct lockstat_class snap;
+	int spl;
+
+	/* Copy it out so we don't print with lc_lock held. */
+	spl = splhigh();
+	lockstat_lock(&lc->lc_lock);
+	snap = *lc;
+	lockstat_unlock(&lc->lc_lock);
+	splx(spl);
+
+	if (snap.lc_acquires == 0) {
+		return;
+	}
+	if (snap.lc_caller != NULL) {
+		kprintf("%-16s %p", snap.lc_name, snap.lc_caller);
+	}
+	else {
+		kprintf("%-27s", snap.lc_name);
+	}
+	kprintf(" %9llu %8llu %9llu %9llu %9llu %9llu\n",
+		(unsigned long long)snap.lc_acquires,
+		(unsigned long long)snap.lc_contended,
+		(unsigned long long)(snap.lc_waitns / snap.lc_acquires),
+		(unsigned long long)snap.lc_maxwaitns,
+		(unsigned long long)(snap.lc_holdns / snap.lc_acquires),
+		(unsigned long long)snap.lc_maxholdns);
+}
+
+/*
+ * Print everything that has been acquired since the last reset.
+ * Times are in nanoseconds.
+ */
+void
+lockstat_dump(void)
+{
+	unsigned i;
+
+	kprintf("%-27s %9s %8s %9s %9s %9s %9s\n", "lock",
+		"acquires", "contend", "avgwait", "maxwait",
+		"avghold", "maxhold");
+	for (i=0; i<LOCKSTAT_NCLASSES; i++) {
+		if (lockstat_table[i].lc_used) {
+			lockstat_print(&lockstat_table[i]);
+		}
+	}
+	lockstat_print(&lockstat_overflow);
+}
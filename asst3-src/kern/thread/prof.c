@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Sampling profiler.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <membar.h>
+#include <cpu.h>
+#include <current.h>
+#include <ksyms.h>
+#include <prof.h>
+
+/* Linker-provided end of the kernel's code (see ldscript). */
+extern char _etext[];
+
+/*
+ * A cpu's counts. pb_hits has one entry per kernel symbol; pb_other
+ * counts kernel samples that aren't in any symbol we know of.
+ */
+struct profbuf {
+	unsigned pb_idle;
+	unsigned pb_user;
+	unsigned pb_other;
+	unsigned *pb_hits;
+};
+
+volatile bool prof_running;
+
+/*
+ * Find the symbol containing PC, by binary search. Returns ksyms_num
+ * if there isn't one.
+ */
+static
+unsigned
+prof_lookup(vaddr_t pc)
+{
+	unsigned lo, hi, mid;
+
+	if (ksyms_num == 0 || pc < ksyms[0].ks_addr ||
+	    pc >= (vaddr_t)_etext) {
+		return ksyms_num;
+	}
+
+	/* Invariant: ksyms[lo].ks_addr <= pc < ksyms[hi].ks_addr */
+	lo = 0;
+	hi = ksyms_num;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (ksyms[mid].ks_addr <= pc) {
+			lo = mid;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/*
+ * Take a sample. This runs in the timer interrupt; mips_trap has
+ * left behind where the interrupt came from.
+ */
+void
+prof_sample(void)
+{
+	struct profbuf *pb;
+	unsigned i;
+
+	pb = curcpu->c_prof;
+	if (pb == NULL) {
+		return;
+	}
+
+	if (curcpu->c_isidle) {
+		pb->pb_idle++;
+	}
+	else if (curcpu->c_intr_user) {
+		pb->pb_user++;
+	}
+	else {
+		i = prof_lookup(curcpu->c_intr_pc);
+		if (i == ksyms_num) {
+			pb->pb_other++;
+		}
+		else {
+			pb->pb_hits[i]++;
+		}
+	}
+}
+
+/*
+ * Start (or restart) sampling with the counts at zero. Buffers are
+ * allocated the first time and kept.
+ */
+int
+prof_start(void)
+{
+	struct profbuf *pb;
+	struct cpu *c;
+	unsigned i, numcpus;
+
+	prof_running = false;
+
+	numcpus = cpu_count();
+	for (i=0; i<numcpus; i++) {
+		c = cpu_get(i);
+		pb = c->c_prof;
+		if (pb == NULL) {
+			pb = kmalloc(sizeof(*pb));
+			if (pb == NULL) {
+				return ENOMEM;
+			}
+			/* Allocate at least one so kmalloc is happy. */
+			pb->pb_hits = kmalloc((ksyms_num + 1) *
+					      sizeof(pb->pb_hits[0]));
+			if (pb->pb_hits == NULL) {
+				kfree(pb);
+				return ENOMEM;
+			}
+		}
+		pb->pb_idle = 0;
+		pb->pb_user = 0;
+		pb->pb_other = 0;
+		bzero(pb->pb_hits, ksyms_num * sizeof(pb->pb_hits[0]));
+		if (c->c_prof == NULL) {
+			membar_store_store();
+			c->c_prof = pb;
+		}
+	}
+
+	prof_running = true;
+	return 0;
+}
+
+void
+prof_stop(void)
+{
+	prof_running = false;
+}
+
+/*
+ * Add up the counts from all the cpus and print them, along with the
+ * NUM hottest kernel functions.
+ */
+void
+prof_print(unsigned num)
+{
+	struct profbuf *pb;
+	unsigned *hits;
+	unsigned idle, user, other, kern, total;
+	unsigned i, j, best, numcpus;
+
+	if (ksyms_num == 0) {
+		kprintf("prof: No kernel symbol table\n");
+		return;
+	}
+	hits = kmalloc(ksyms_num * sizeof(hits[0]));
+	if (hits == NULL) {
+		kprintf("prof: Out of memory\n");
+		return;
+	}
+	bzero(hits, ksyms_num * sizeof(hits[0]));
+
+	idle = user = other = kern = 0;
+	numcpus = cpu_count();
+	for (i=0; i<numcpus; i++) {
+		pb = cpu_get(i)->c_prof;
+		if (pb == NULL) {
+			continue;
+		}
+		idle += pb->pb_idle;
+		user += pb->pb_user;
+		other += pb->pb_other;
+		for (j=0; j<ksyms_num; j++) {
+			hits[j] += pb->pb_hits[j];
+			kern += pb->pb_hits[j];
+		}
+	}
+	kern += other;
+	total = idle + user + kern;
+
+	kprintf("%u samples%s: %u idle, %u user, %u kernel\n", total,
+		prof_running ? " so far" : "", idle, user, kern);
+	if (total == 0) {
+		kfree(hits);
+		return;
+	}
+	if (other > 0) {
+		kprintf("%8u %3u.%u%%  (unknown)\n", other,
+			(1000 * other / total) / 10, (1000 * other / total) % 10);
+	}
+
+	/* Selection by repeated scan; NUM is small. */
+	for (i=0; i<num; i++) {
+		best = 0;
+		for (j=1; j<ksyms_num; j++) {
+			if (hits[j] > hits[best]) {
+				best = j;
+			}
+		}
+		if (hits[best] == 0) {
+			break;
+		}
+		kprintf("%8u %3u.%u%%  %s\n", hits[best],
+			(1000 * hits[best] / total) / 10,
+			(1000 * hits[best] / total) % 10,
+			ksyms[best].ks_name);
+		hits[best] = 0;
+	}
+
+	kfree(hits);
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Quiescent-state based RCU. See rcu.h.
+ *
+ * Grace periods are numbered. Starting one bumps rcu_curgp and sets
+ * rcu_cpusleft to the number of cpus that have yet to pass through a
+ * quiescent state; cpus that are idle at that point already have. A
+ * cpu notes in c_rcu_gp the last grace period it reported for, so it
+ * reports each one only once. When the count reaches zero the grace
+ * period is over.
+ *
+ * Callbacks wait on three lists: rcu_next for those queued since the
+ * current grace period started, rcu_cur for those waiting for it to
+ * end, and rcu_done for those ready to run. Whenever a grace period
+ * ends, rcu_cur moves to rcu_done and, if anything is in rcu_next,
+ * it becomes rcu_cur and another grace period starts. Grace periods
+ * are only run while there are callbacks waiting.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <spl.h>
+#include <membar.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <wchan.h>
+#include <workq.h>
+#include <rcu.h>
+
+struct rcu_list {
+	struct rcu_head *rl_head;
+	struct rcu_head **rl_tail;
+};
+
+static struct spinlock rcu_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned rcu_curgp;	/* Current grace period */
+static volatile bool rcu_gpactive;	/* Is it still running? */
+static unsigned rcu_cpusleft;		/* Cpus yet to report */
+static struct rcu_list rcu_next, rcu_cur, rcu_done;
+static struct workitem rcu_work;	/* Runs rcu_done */
+static struct wchan *rcu_wchan;		/* For synchronize_rcu */
+
+static
+void
+rcu_list_init(struct rcu_list *rl)
+{
+	rl->rl_head = NULL;
+	rl->rl_tail = &rl->rl_head;
+}
+
+static
+bool
+rcu_list_isempty(struct rcu_list *rl)
+{
+	return rl->rl_head == NULL;
+}
+
+static
+void
+rcu_list_add(struct rcu_list *rl, struct rcu_head *rh)
+{
+	rh->rh_next = NULL;
+	*rl->rl_tail = rh;
+	rl->rl_tail = &rh->rh_next;
+}
+
+/*
+ * Move all of FROM to the end of TO.
+ */
+static
+void
+rcu_list_move(struct rcu_list *to, struct rcu_list *from)
+{
+	if (rcu_list_isempty(from)) {
+		return;
+	}
+	*to->rl_tail = from->rl_head;
+	to->rl_tail = from->rl_tail;
+	rcu_list_init(from);
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Run callbacks whose grace period is over. Called from the work
+ * queue.
+ */
+static
+void
+rcu_runcallbacks(void *data)
+{
+	struct rcu_head *rh, *next;
+
+	(void)data;
+
+	spinlock_acquire(&rcu_lock);
+	rh = rcu_done.rl_head;
+	rcu_list_init(&rcu_done);
+	spinlock_release(&rcu_lock);
+
+	while (rh != NULL) {
+		/* The callback may well free RH. */
+		next = rh->rh_next;
+		rh->rh_func(rh->rh_data);
+		rh = next;
+	}
+}
+
+static void rcu_endgp(void);
+
+/*
+ * Start a grace period for the callbacks in rcu_next.
+ */
+static
+void
+rcu_startgp(void)
+{
+	struct cpu *c;
+	unsigned i, num;
+
+	KASSERT(spinlock_do_i_hold(&rcu_lock));
+	KASSERT(!rcu_gpactive);
+	KASSERT(rcu_list_isempty(&rcu_cur));
+
+	rcu_list_move(&rcu_cur, &rcu_next);
+	rcu_curgp++;
+	rcu_gpactive = true;
+	rcu_cpusleft = 0;
+
+	/* Make sure the idle checks below see current state. */
+	membar_any_any();
+
+	num = cpu_count();
+	for (i=0; i<num; i++) {
+		c = cpu_get(i);
+		if (c->c_isidle) {
+			/* It can't be in a read section. */
+			c->c_rcu_gp = rcu_curgp;
+		}
+		else {
+			rcu_cpusleft++;
+		}
+	}
+
+	if (rcu_cpusleft == 0) {
+		rcu_endgp();
+	}
+}
+
+/*
+ * The current grace period is over.
+ */
+static
+void
+rcu_endgp(void)
+{
+	KASSERT(spinlock_do_i_hold(&rcu_lock));
+	KASSERT(rcu_gpactive);
+
+	rcu_gpactive = false;
+	rcu_list_move(&rcu_done, &rcu_cur);
+	workq_schedule(&rcu_work);
+
+	if (!rcu_list_isempty(&rcu_next)) {
+		rcu_startgp();
+	}
+}
+
+/*
+ * Called at splhigh, so curcpu can't change under us.
+ */
+void
+rcu_quiescent(void)
+{
+	/* Quick check without the lock; most of the time there's nothing. */
+	if (!rcu_gpactive || curcpu->c_rcu_gp == rcu_curgp) {
+		return;
+	}
+
+	spinlock_acquire(&rcu_lock);
+	if (rcu_gpactive && curcpu->c_rcu_gp != rcu_curgp) {
+		curcpu->c_rcu_gp = rcu_curgp;
+		KASSERT(rcu_cpusleft > 0);
+		rcu_cpusleft--;
+		if (rcu_cpusleft == 0) {
+			rcu_endgp();
+		}
+	}
+	spinlock_release(&rcu_lock);
+}
+
+////////////////////////////////////////////////////////////
+
+void
+rcu_bootstrap(void)
+{
+	rcu_list_init(&rcu_next);
+	rcu_list_init(&rcu_cur);
+	rcu_list_init(&rcu_done);
+	workitem_init(&rcu_work, rcu_runcallbacks, NULL);
+	rcu_wchan = wchan_create("rcu");
+	if (rcu_wchan == NULL) {
+		panic("rcu_bootstrap: Out of memory\n");
+	}
+}
+
+void
+rcu_read_lock(void)
+{
+	struct thread *cur = curthread;
+	int spl;
+
+	spl = splhigh();
+	if (cur->t_rcu_depth == 0) {
+		cur->t_rcu_spl = spl;
+	}
+	cur->t_rcu_depth++;
+}
+
+void
+rcu_read_unlock(void)
+{
+	struct thread *cur = curthread;
+
+	KASSERT(cur->t_rcu_depth > 0);
+	cur->t_rcu_depth--;
+	if (cur->t_rcu_depth == 0) {
+		splx(cur->t_rcu_spl);
+	}
+}
+
+void
+call_rcu(struct rcu_head *rh, void (*func)(void *), void *data)
+{
+	rh->rh_func = func;
+	rh->rh_data = data;
+
+	spinlock_acquire(&rcu_lock);
+	rcu_list_add(&rcu_next, rh);
+	if (!rcu_gpactive) {
+		rcu_startgp();
+	}
+	spinlock_release(&rcu_lock);
+}
+
+/*
+ * Callback for synchronize_rcu.
+ */
+static
+void
+rcu_wakeup(void *data)
+{
+	volatile bool *done = data;
+
+	spinlock_acquire(&rcu_lock);
+	*done = true;
+	wchan_wakeall(rcu_wchan, &rcu_lock);
+	spinlock_release(&rcu_lock);
+}
+
+void
+synchronize_rcu(void)
+{
+	struct rcu_head rh;
+	volatile bool done = false;
+
+	KASSERT(!curthread->t_in_interrupt);
+	KASSERT(curthread->t_rcu_depth == 0);
+
+	call_rcu(&rh, rcu_wakeup, (void *)&done);
+
+	spinlock_acquire(&rcu_lock);
+	while (!done) {
+		wchan_sleep(rcu_wchan, &rcu_lock);
+	}
+	spinlock_release(&rcu_lock);
+}
@@ -50,9 +50,11 @@
 void
 spinlock_init(struct spinlock *splk)
 {
-	spinlock_data_set(&splk->splk_lock, 0);
+	spinlock_data_set(&splk->splk_next, 0);
+	spinlock_data_set(&splk->splk_serving, 0);
 	splk->splk_holder = NULL;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
+	LOCKSTAT_LOCKABLEINIT(&splk->splk_lockstat, NULL);
 }
 
 /*
@@ -62,20 +64,23 @@ void
 spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
-	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	KASSERT(spinlock_data_get(&splk->splk_next) ==
+		spinlock_data_get(&splk->splk_serving));
 }
 
 /*
  * Get the lock.
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
- * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * might come back to this lock and deadlock), then take a ticket with
+ * a machine-level atomic operation and wait for our turn.
  */
 void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket;
+	bool contended;
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -88,29 +93,23 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu->c_spinlocks++;
 
 		HANGMAN_WAIT(&curcpu->c_hangman, &splk->splk_hangman);
+		LOCKSTAT_WAIT(&curcpu->c_lockstat);
 	}
 	else {
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
-		}
-		break;
+	/*
+	 * Fetch-and-increment is the only atomic write; after that we
+	 * just read splk_serving, which changes once per release, so
+	 * waiters don't fight over the cache line while the holder
+	 * runs. Tickets wrap around harmlessly since only equality is
+	 * tested.
+	 */
+	ticket = spinlock_data_fetchinc(&splk->splk_next);
+	contended = spinlock_data_get(&splk->splk_serving) != ticket;
+	while (spinlock_data_get(&splk->splk_serving) != ticket) {
+		/* spin */
 	}
 
 	membar_store_any();
@@ -118,6 +117,8 @@ spinlock_acquire(struct spinlock *splk)
 
 	if (CURCPU_EXISTS()) {
 		HANGMAN_ACQUIRE(&curcpu->c_hangman, &splk->splk_hangman);
+		LOCKSTAT_ACQUIRE(&curcpu->c_lockstat, &splk->splk_lockstat,
+				 contended, __builtin_return_address(0));
 	}
 }
 
@@ -133,11 +134,14 @@ spinlock_release(struct spinlock *splk)
 		KASSERT(curcpu->c_spinlocks > 0);
 		curcpu->c_spinlocks--;
 		HANGMAN_RELEASE(&curcpu->c_hangman, &splk->splk_hangman);
+		LOCKSTAT_RELEASE(&splk->splk_lockstat);
 	}
 
 	splk->splk_holder = NULL;
 	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	/* Only the holder writes splk_serving, so no atomic op is needed. */
+	spinlock_data_set(&splk->splk_serving,
+			  spinlock_data_get(&splk->splk_serving) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -36,9 +36,11 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <trace.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -155,6 +157,7 @@ lock_create(const char *name)
 	}
 
 	HANGMAN_LOCKABLEINIT(&lock->lk_hangman, lock->lk_name);
+	LOCKSTAT_LOCKABLEINIT(&lock->lk_lockstat, lock->lk_name);
 
 	lock->lk_wchan = wchan_create(lock->lk_name);
 	if (lock->lk_wchan == NULL) {
@@ -164,6 +167,8 @@ lock_create(const char *name)
 	}
 	spinlock_init(&lock->lk_lock);
 	lock->lk_holder = NULL;
+	lock->lk_waiters = 0;
+	lock->lk_handoff = false;
 
 	return lock;
 }
@@ -174,6 +179,7 @@ lock_destroy(struct lock *lock)
 	KASSERT(lock != NULL);
 
 	KASSERT(lock->lk_holder == NULL);
+	KASSERT(lock->lk_waiters == 0);
 	spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
 
@@ -181,44 +187,220 @@ lock_destroy(struct lock *lock)
 	kfree(lock);
 }
 
+/*
+ * Check if a lock holder is currently running on some other cpu, in
+ * which case it's likely to release the lock before we could finish
+ * going to sleep and being woken up again.
+ */
+static
+bool
+lock_holder_running(struct thread *holder)
+{
+	return holder->t_state == S_RUN && holder->t_cpu != curcpu->c_self;
+}
+
+/*
+ * Spin (without holding lk_lock) until HOLDER lets go of the lock or
+ * stops running. HOLDER may exit once it has released the lock; the
+ * stale read of its t_state that can follow is harmless since thread
+ * structures live in directly-mapped kernel memory.
+ */
+static
 void
-lock_acquire(struct lock *lock)
+lock_spin(struct lock *lock, struct thread *holder)
 {
-	DEBUGASSERT(lock != NULL);
-	KASSERT(curthread->t_in_interrupt == false);
+	volatile threadstate_t *state = &holder->t_state;
 
-	spinlock_acquire(&lock->lk_lock);
+	while (lock->lk_holder == holder && *state == S_RUN) {
+		/* spin */
+	}
+}
 
-	/* Call this (atomically) before waiting for a lock */
-	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
+/*
+ * Priority inheritance.
+ *
+ * Before sleeping on a lock, a thread lends its level (see
+ * thread_priority) to the holder, and, if that holder is itself
+ * blocked on a lock, to that lock's holder, and so on down the chain
+ * of waits-for edges, as hangman follows them. Waiters that
+ * cv_signal or cv_broadcast move onto a lock's queue lend theirs when
+ * they're moved. A holder keeps what it inherited until it has
+ * released all of its locks.
+ *
+ * lock_pi_lock protects the t_waitlock edges and serializes chain
+ * walks. It comes after lk_lock and before the runqueue locks. Only
+ * the first lock's lk_lock is held during a walk; holders further
+ * down the chain are pinned instead by lock_unhold, which clears
+ * lk_holder under lock_pi_lock whenever the lock has waiters. A walk
+ * only reaches a lock through a thread blocked on it, so any holder
+ * it finds can't let go, let alone exit, until the walk is done, and
+ * still holds at least one lock; its boost is therefore dropped, as
+ * usual, when it releases its last lock.
+ *
+ * The walk is bounded in case of a deadlock cycle (which hangman, if
+ * enabled, will report).
+ */
+#define LOCK_PI_MAXDEPTH 16
+static struct spinlock lock_pi_lock = SPINLOCK_INITIALIZER;
+
+static
+void
+lock_pi_block(struct lock *lock, struct thread *waiter)
+{
+	struct thread *holder;
+	struct lock *next;
+	unsigned pri, depth;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+
+	pri = thread_priority(waiter);
+
+	spinlock_acquire(&lock_pi_lock);
+	waiter->t_waitlock = lock;
+	holder = lock->lk_holder;
+	for (depth = 0; holder != NULL && depth < LOCK_PI_MAXDEPTH; depth++) {
+		if (thread_priority(holder) <= pri) {
+			/* It, and everything it waits for, is urgent enough. */
+			break;
+		}
+		thread_inherit(holder, pri);
+		/*
+		 * HOLDER is blocked on NEXT, so NEXT has a waiter and
+		 * its holder is pinned until we drop lock_pi_lock.
+		 */
+		next = holder->t_waitlock;
+		if (next == NULL) {
+			break;
+		}
+		holder = next->lk_holder;
+	}
+	spinlock_release(&lock_pi_lock);
+}
+
+static
+void
+lock_pi_unblock(void)
+{
+	spinlock_acquire(&lock_pi_lock);
+	curthread->t_waitlock = NULL;
+	spinlock_release(&lock_pi_lock);
+}
+
+/*
+ * Wait for the lock and take it. Called with lk_lock held, after
+ * HANGMAN_WAIT. HANDEDOFF is true if we've already been handed the
+ * lock by lock_release (see cv_wait).
+ */
+static
+void
+lock_wait(struct lock *lock, bool handedoff)
+{
+	struct thread *holder;
+	bool contended = false;
 
 	KASSERT(lock->lk_holder != curthread);
-	while (lock->lk_holder != NULL) {
-		/* As in the semaphore. */
+	while (lock->lk_holder != NULL || (lock->lk_handoff && !handedoff)) {
+		contended = true;
+		holder = lock->lk_holder;
+		if (holder != NULL && lock_holder_running(holder)) {
+			spinlock_release(&lock->lk_lock);
+			lock_spin(lock, holder);
+			spinlock_acquire(&lock->lk_lock);
+			continue;
+		}
+
+		/*
+		 * The only thing that wakes lk_wchan is lock_release
+		 * handing the lock to us; lk_waiters is decremented
+		 * there.
+		 */
+		lock_pi_block(lock, curthread);
+		lock->lk_waiters++;
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+		lock_pi_unblock();
+		handedoff = true;
 	}
+	KASSERT(lock->lk_holder == NULL);
 	lock->lk_holder = curthread;
+	lock->lk_handoff = false;
+	curthread->t_locksheld++;
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
-
-	spinlock_release(&lock->lk_lock);
+	LOCKSTAT_ACQUIRE(&curthread->t_lockstat, &lock->lk_lockstat,
+			 contended, NULL);
+	TRACE(TRC_LOCK, TRE_LOCK, (uintptr_t)lock, contended);
 }
 
+/*
+ * Let go of the lock. Called with lk_lock held.
+ */
+static
 void
-lock_release(struct lock *lock)
+lock_unhold(struct lock *lock)
 {
-	DEBUGASSERT(lock != NULL);
-
-	spinlock_acquire(&lock->lk_lock);
+	bool waited;
 
 	KASSERT(lock->lk_holder == curthread);
+
+	/*
+	 * If anyone is waiting, a priority inheritance walk may have
+	 * reached us through this lock (see lock_pi_block); don't let
+	 * go while it's looking.
+	 */
+	waited = lock->lk_waiters > 0;
+	if (waited) {
+		spinlock_acquire(&lock_pi_lock);
+	}
 	lock->lk_holder = NULL;
-	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
+	KASSERT(curthread->t_locksheld > 0);
+	curthread->t_locksheld--;
+	if (waited) {
+		spinlock_release(&lock_pi_lock);
+	}
+
+	if (curthread->t_locksheld == 0 &&
+	    curthread->t_inherit != THREAD_NOINHERIT) {
+		/* Nobody can be waiting on us any more. */
+		thread_inherit(curthread, THREAD_NOINHERIT);
+	}
+
+	if (lock->lk_waiters > 0) {
+		/* Hand the lock to exactly one sleeper. */
+		lock->lk_waiters--;
+		lock->lk_handoff = true;
+		wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
+	}
 
 	/* Call this (atomically) when the lock is released */
 	HANGMAN_RELEASE(&curthread->t_hangman, &lock->lk_hangman);
+	LOCKSTAT_RELEASE(&lock->lk_lockstat);
+}
+
+void
+lock_acquire(struct lock *lock)
+{
+	DEBUGASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&lock->lk_lock);
 
+	/* Call this (atomically) before waiting for a lock */
+	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
+	LOCKSTAT_WAIT(&curthread->t_lockstat);
+
+	lock_wait(lock, false);
+
+	spinlock_release(&lock->lk_lock);
+}
+
+void
+lock_release(struct lock *lock)
+{
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+	lock_unhold(lock);
 	spinlock_release(&lock->lk_lock);
 }
 
@@ -264,7 +446,8 @@ cv_create(const char *name)
 		return NULL;
 	}
 
-	spinlock_init(&cv->cv_wchanlock);
+	cv->cv_lock = NULL;
+	cv->cv_waiters = 0;
 	return cv;
 }
 
@@ -273,45 +456,259 @@ cv_destroy(struct cv *cv)
 {
 	KASSERT(cv != NULL);
 
-	spinlock_cleanup(&cv->cv_wchanlock);
+	KASSERT(cv->cv_waiters == 0);
 	wchan_destroy(cv->cv_wchan);
 
 	kfree(cv->cv_name);
 	kfree(cv);
 }
 
+/*
+ * Waiters sleep on cv_wchan under the lock's own spinlock, so that
+ * cv_signal and cv_broadcast can move them straight onto the lock's
+ * wait queue (wait morphing) instead of waking them just to have them
+ * go back to sleep on the lock the signaller still holds. A woken
+ * waiter has therefore already been handed the lock by lock_release.
+ */
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
-	spinlock_acquire(&cv->cv_wchanlock);
-	lock_release(lock);
-	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
-	/*
-	 * It is kind of silly to acquire this spinlock in wchan_sleep
-	 * and then release it right away. If we were going for
-	 * performance we might pass a flag to avoid that in this
-	 * case. Or we might use lock->lk_lock to protect the wchan
-	 * and separate out enough of the lock_acquire/lock_release
-	 * logic to make that work cleanly.
-	 */
-	spinlock_release(&cv->cv_wchanlock);
-	lock_acquire(lock);
+	DEBUGASSERT(cv != NULL);
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+
+	KASSERT(cv->cv_waiters == 0 || cv->cv_lock == lock);
+	cv->cv_lock = lock;
+	cv->cv_waiters++;
+
+	lock_unhold(lock);
+	wchan_sleep(cv->cv_wchan, &lock->lk_lock);
+	lock_pi_unblock();
+
+	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
+	LOCKSTAT_WAIT(&curthread->t_lockstat);
+	lock_wait(lock, true);
+
+	spinlock_release(&lock->lk_lock);
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
-	(void)lock;
-	spinlock_acquire(&cv->cv_wchanlock);
-	wchan_wakeone(cv->cv_wchan, &cv->cv_wchanlock);
-	spinlock_release(&cv->cv_wchanlock);
+	struct thread *t;
+
+	DEBUGASSERT(cv != NULL);
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+
+	KASSERT(lock->lk_holder == curthread);
+	if (cv->cv_waiters > 0) {
+		KASSERT(cv->cv_lock == lock);
+		t = wchan_moveone(cv->cv_wchan, lock->lk_wchan,
+				  &lock->lk_lock);
+		if (t != NULL) {
+			cv->cv_waiters--;
+			lock->lk_waiters++;
+			lock_pi_block(lock, t);
+		}
+	}
+
+	spinlock_release(&lock->lk_lock);
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-	(void)lock;
-	spinlock_acquire(&cv->cv_wchanlock);
-	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
-	spinlock_release(&cv->cv_wchanlock);
+	struct thread *t;
+
+	DEBUGASSERT(cv != NULL);
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+
+	KASSERT(lock->lk_holder == curthread);
+	if (cv->cv_waiters > 0) {
+		KASSERT(cv->cv_lock == lock);
+		while ((t = wchan_moveone(cv->cv_wchan, lock->lk_wchan,
+					  &lock->lk_lock)) != NULL) {
+			KASSERT(cv->cv_waiters > 0);
+			cv->cv_waiters--;
+			lock->lk_waiters++;
+			lock_pi_block(lock, t);
+		}
+	}
+
+	spinlock_release(&lock->lk_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rwlock;
+
+	rwlock = kmalloc(sizeof(*rwlock));
+	if (rwlock == NULL) {
+		return NULL;
+	}
+
+	rwlock->rwl_name = kstrdup(name);
+	if (rwlock->rwl_name == NULL) {
+		kfree(rwlock);
+		return NULL;
+	}
+
+	HANGMAN_LOCKABLEINIT(&rwlock->rwl_hangman, rwlock->rwl_name);
+	LOCKSTAT_LOCKABLEINIT(&rwlock->rwl_lockstat, rwlock->rwl_name);
+
+	rwlock->rwl_rwchan = wchan_create(rwlock->rwl_name);
+	if (rwlock->rwl_rwchan == NULL) {
+		kfree(rwlock->rwl_name);
+		kfree(rwlock);
+		return NULL;
+	}
+	rwlock->rwl_wwchan = wchan_create(rwlock->rwl_name);
+	if (rwlock->rwl_wwchan == NULL) {
+		wchan_destroy(rwlock->rwl_rwchan);
+		kfree(rwlock->rwl_name);
+		kfree(rwlock);
+		return NULL;
+	}
+	spinlock_init(&rwlock->rwl_lock);
+	rwlock->rwl_readers = 0;
+	rwlock->rwl_rwaiting = 0;
+	rwlock->rwl_wwaiting = 0;
+	rwlock->rwl_admit = 0;
+	rwlock->rwl_readgen = 0;
+	rwlock->rwl_writer = NULL;
+
+	return rwlock;
+}
+
+void
+rwlock_destroy(struct rwlock *rwlock)
+{
+	KASSERT(rwlock != NULL);
+
+	KASSERT(rwlock->rwl_readers == 0);
+	KASSERT(rwlock->rwl_writer == NULL);
+	KASSERT(rwlock->rwl_rwaiting == 0);
+	KASSERT(rwlock->rwl_wwaiting == 0);
+	spinlock_cleanup(&rwlock->rwl_lock);
+	wchan_destroy(rwlock->rwl_wwchan);
+	wchan_destroy(rwlock->rwl_rwchan);
+
+	kfree(rwlock->rwl_name);
+	kfree(rwlock);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rwlock)
+{
+	unsigned gen;
+
+	DEBUGASSERT(rwlock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rwlock->rwl_lock);
+
+	KASSERT(rwlock->rwl_writer != curthread);
+	gen = rwlock->rwl_readgen;
+	while (rwlock->rwl_writer != NULL ||
+	       (rwlock->rwl_wwaiting > 0 && rwlock->rwl_readgen == gen)) {
+		rwlock->rwl_rwaiting++;
+		wchan_sleep(rwlock->rwl_rwchan, &rwlock->rwl_lock);
+		rwlock->rwl_rwaiting--;
+	}
+	if (rwlock->rwl_readgen != gen) {
+		/* We were admitted by a departing writer. */
+		KASSERT(rwlock->rwl_admit > 0);
+		rwlock->rwl_admit--;
+	}
+	rwlock->rwl_readers++;
+
+	spinlock_release(&rwlock->rwl_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rwlock)
+{
+	DEBUGASSERT(rwlock != NULL);
+
+	spinlock_acquire(&rwlock->rwl_lock);
+
+	KASSERT(rwlock->rwl_readers > 0);
+	rwlock->rwl_readers--;
+	if (rwlock->rwl_readers == 0 && rwlock->rwl_admit == 0 &&
+	    rwlock->rwl_wwaiting > 0) {
+		wchan_wakeone(rwlock->rwl_wwchan, &rwlock->rwl_lock);
+	}
+
+	spinlock_release(&rwlock->rwl_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rwlock)
+{
+	bool contended = false;
+
+	DEBUGASSERT(rwlock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rwlock->rwl_lock);
+
+	HANGMAN_WAIT(&curthread->t_hangman, &rwlock->rwl_hangman);
+	LOCKSTAT_WAIT(&curthread->t_lockstat);
+
+	KASSERT(rwlock->rwl_writer != curthread);
+	while (rwlock->rwl_writer != NULL || rwlock->rwl_readers > 0 ||
+	       rwlock->rwl_admit > 0) {
+		contended = true;
+		rwlock->rwl_wwaiting++;
+		wchan_sleep(rwlock->rwl_wwchan, &rwlock->rwl_lock);
+		rwlock->rwl_wwaiting--;
+	}
+	rwlock->rwl_writer = curthread;
+
+	HANGMAN_ACQUIRE(&curthread->t_hangman, &rwlock->rwl_hangman);
+	LOCKSTAT_ACQUIRE(&curthread->t_lockstat, &rwlock->rwl_lockstat,
+			 contended, NULL);
+
+	spinlock_release(&rwlock->rwl_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rwlock)
+{
+	DEBUGASSERT(rwlock != NULL);
+
+	spinlock_acquire(&rwlock->rwl_lock);
+
+	KASSERT(rwlock->rwl_writer == curthread);
+	rwlock->rwl_writer = NULL;
+	if (rwlock->rwl_rwaiting > 0) {
+		/* Let everyone who waited during our turn go next. */
+		rwlock->rwl_admit = rwlock->rwl_rwaiting;
+		rwlock->rwl_readgen++;
+		wchan_wakeall(rwlock->rwl_rwchan, &rwlock->rwl_lock);
+	}
+	else if (rwlock->rwl_wwaiting > 0) {
+		wchan_wakeone(rwlock->rwl_wwchan, &rwlock->rwl_lock);
+	}
+
+	HANGMAN_RELEASE(&curthread->t_hangman, &rwlock->rwl_hangman);
+	LOCKSTAT_RELEASE(&rwlock->rwl_lockstat);
+
+	spinlock_release(&rwlock->rwl_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rwlock)
+{
+	return rwlock->rwl_writer == curthread;
 }
@@ -41,6 +41,7 @@
 #include <array.h>
 #include <cpu.h>
 #include <spl.h>
+#include <membar.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
@@ -53,11 +54,41 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <clock.h>
+#include <timeout.h>
+#include <workq.h>
+#include <rcu.h>
+#include <trace.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Maximum number of exited threads (struct thread plus kernel stack)
+ * each cpu keeps around for reuse by thread_fork.
+ */
+#define THREAD_POOL_MAX 8
+
+/*
+ * Multilevel feedback queue parameters. Threads start at level 0 and
+ * are demoted one level each time they use up the quantum for their
+ * level, which is given in hardclocks. They move up one level when
+ * woken from a wait channel, and everything goes back to level 0
+ * whenever schedule() runs.
+ */
+#define MLFQ_LEVELS 4
+static const unsigned mlfq_quantum[MLFQ_LEVELS] = { 1, 2, 4, 8 };
+
+/* Quantum for SCHED_RR threads, in hardclocks. */
+#define RT_QUANTUM 4
+
+/*
+ * A thread that stopped running on a cpu no more than this many
+ * hardclocks ago is assumed to still have a warm cache there.
+ */
+#define CACHE_WARM_HARDCLOCKS 2
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -111,9 +142,88 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Thread pool.
+ *
+ * Rather than freeing the struct thread and kernel stack of every
+ * exited thread and allocating them again on the next thread_fork,
+ * each cpu keeps up to THREAD_POOL_MAX of them on c_threadpool. The
+ * pool is filled lazily: exorcise() recycles zombies into it, and
+ * thread_create() takes from it before falling back to kmalloc.
+ *
+ * Like c_zombies, the pool is only touched by its own cpu, so raising
+ * the spl (to keep the timer from switching us into exorcise, or
+ * onto another cpu) is enough to protect it.
+ */
+
+/*
+ * Take a recycled thread, with its stack, from the current cpu's
+ * pool. Returns NULL if the pool is empty. The stack guard band was
+ * checked when the thread went into the pool and is still intact, so
+ * it doesn't need to be written again.
+ */
+static
+struct thread *
+thread_pool_get(void)
+{
+	struct thread *thread;
+	int spl;
+
+	/* thread_create runs before curcpu exists for the boot cpu */
+	if (!CURCPU_EXISTS()) {
+		return NULL;
+	}
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadpool);
+	splx(spl);
+
+	if (thread != NULL) {
+		KASSERT(thread->t_stack != NULL);
+		KASSERT(thread->t_name == NULL);
+	}
+	return thread;
+}
+
+/*
+ * Put a zombie into the current cpu's pool instead of destroying it.
+ * Returns false if it should be destroyed after all, either because
+ * the pool is full or because its stack can't be reused.
+ *
+ * Called from exorcise(), so the spl is already raised.
+ */
+static
+bool
+thread_pool_put(struct thread *thread)
+{
+	KASSERT(curthread->t_curspl > IPL_NONE);
+	KASSERT(thread->t_state == S_ZOMBIE);
+	KASSERT(thread->t_proc == NULL);
+
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadpool.tl_count >= THREAD_POOL_MAX) {
+		return false;
+	}
+
+	thread_checkstack(thread);
+	thread_machdep_cleanup(&thread->t_machdep);
+
+	kfree(thread->t_name);
+	thread->t_name = NULL;
+	thread->t_wchan_name = "POOLED";
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+
+	threadlist_addhead(&curcpu->c_threadpool, thread);
+	return true;
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
+ *
+ * If the thread comes from the thread pool, t_stack is already set;
+ * otherwise it is NULL and the caller should allocate a stack.
  */
 static
 struct thread *
@@ -123,13 +233,20 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = thread_pool_get();
 	if (thread == NULL) {
-		return NULL;
+		thread = kmalloc(sizeof(*thread));
+		if (thread == NULL) {
+			return NULL;
+		}
+		thread->t_stack = NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
+		if (thread->t_stack != NULL) {
+			kfree(thread->t_stack);
+		}
 		kfree(thread);
 		return NULL;
 	}
@@ -139,11 +256,33 @@ thread_create(const char *name)
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
+	thread->t_intransit = false;
 	thread->t_proc = NULL;
+	thread->t_tid = 0;
 	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+	LOCKSTAT_ACTORINIT(&thread->t_lockstat);
+
+	/* Scheduler fields */
+	thread->t_priority = 0;
+	thread->t_ticks = 0;
+	thread->t_policy = SCHED_OTHER;
+	thread->t_rtprio = 0;
+	thread->t_inherit = THREAD_NOINHERIT;
+	thread->t_waitlock = NULL;
+	thread->t_locksheld = 0;
+	thread->t_lastcpu = NULL;
+	thread->t_lastrun = 0;
+	thread->t_affinity = THREAD_AFFINITY_ALL;
+
+	/* Accounting fields */
+	bzero(&thread->t_stats, sizeof(thread->t_stats));
+	thread->t_readystamp = 0;
+
+	/* RCU fields */
+	thread->t_rcu_depth = 0;
+	thread->t_rcu_spl = 0;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
@@ -155,6 +294,29 @@ thread_create(const char *name)
 	return thread;
 }
 
+/*
+ * Body of each cpu's idle thread.
+ *
+ * Normally a cpu with nothing to run idles on the stack of the last
+ * thread it ran. That won't do when that thread has to leave for
+ * another cpu (c_moving; see thread_switch): it can't run anywhere
+ * else while we're still on its stack. So then thread_switch runs
+ * this thread instead, which sends the other one off (in
+ * thread_finish_move, after the switch) and yields straight back
+ * into the idle loop. The idle thread is never on a run queue.
+ */
+static
+void
+thread_idle(void *junk, unsigned long junk2)
+{
+	(void)junk;
+	(void)junk2;
+
+	while (1) {
+		thread_yield();
+	}
+}
+
 /*
  * Create a CPU structure. This is used for the bootup CPU and
  * also for secondary CPUs.
@@ -179,9 +341,21 @@ cpu_create(unsigned hardware_number)
 	c->c_hardware_number = hardware_number;
 
 	c->c_curthread = NULL;
+	c->c_moving = NULL;
+	c->c_idlethread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadpool);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	c->c_idleticks = 0;
+	c->c_workq = NULL;
+	c->c_workq_tail = &c->c_workq;
+	c->c_rcu_gp = 0;
+	c->c_intr_user = false;
+	c->c_intr_pc = 0;
+	c->c_trace = NULL;
+	c->c_prof = NULL;
+	bzero(&c->c_stats, sizeof(c->c_stats));
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -191,6 +365,11 @@ cpu_create(unsigned hardware_number)
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
 
+	c->c_timers = timerwheel_create();
+	if (c->c_timers == NULL) {
+		panic("cpu_create: Out of memory\n");
+	}
+
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
@@ -212,7 +391,7 @@ cpu_create(unsigned hardware_number)
 		 */
 		/*c->c_curthread->t_stack = ... */
 	}
-	else {
+	else if (c->c_curthread->t_stack == NULL) {
 		c->c_curthread->t_stack = kmalloc(STACK_SIZE);
 		if (c->c_curthread->t_stack == NULL) {
 			panic("cpu_create: couldn't allocate stack");
@@ -244,17 +423,59 @@ cpu_create(unsigned hardware_number)
 	}
 
 	HANGMAN_ACTORINIT(&c->c_hangman, "cpu");
+	LOCKSTAT_ACTORINIT(&c->c_lockstat);
 
 	result = proc_addthread(kproc, c->c_curthread);
 	if (result) {
 		panic("cpu_create: proc_addthread:: %s\n", strerror(result));
 	}
 
+	/* Make the idle thread; see thread_idle. */
+	snprintf(namebuf, sizeof(namebuf), "<idle #%d>", c->c_number);
+	c->c_idlethread = thread_create(namebuf);
+	if (c->c_idlethread == NULL) {
+		panic("cpu_create: thread_create failed\n");
+	}
+	if (c->c_idlethread->t_stack == NULL) {
+		c->c_idlethread->t_stack = kmalloc(STACK_SIZE);
+		if (c->c_idlethread->t_stack == NULL) {
+			panic("cpu_create: couldn't allocate stack");
+		}
+		thread_checkstack_init(c->c_idlethread);
+	}
+	c->c_idlethread->t_cpu = c;
+	c->c_idlethread->t_affinity = (uint32_t)1 << c->c_number;
+	result = proc_addthread(kproc, c->c_idlethread);
+	if (result) {
+		panic("cpu_create: proc_addthread:: %s\n", strerror(result));
+	}
+	/* See thread_fork. */
+	c->c_idlethread->t_iplhigh_count++;
+	switchframe_init(c->c_idlethread, thread_idle, NULL, 0);
+
 	cpu_machdep_init(c);
 
 	return c;
 }
 
+/*
+ * Return the number of cpus.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+/*
+ * Return cpu number NUM.
+ */
+struct cpu *
+cpu_get(unsigned num)
+{
+	return cpuarray_get(&allcpus, num);
+}
+
 /*
  * Destroy a thread.
  *
@@ -292,7 +513,8 @@ thread_destroy(struct thread *thread)
 
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) As many as fit are
+ * recycled into the thread pool instead.
  *
  * The list of zombies is per-cpu.
  */
@@ -305,7 +527,9 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_pool_put(z)) {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -445,6 +669,164 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Cpu placement.
+ *
+ * thread_cpu_allowed checks a thread's affinity mask; thread_cache_warm
+ * guesses whether the thread still has cache state on a cpu.
+ */
+static
+bool
+thread_cpu_allowed(const struct thread *t, const struct cpu *c)
+{
+	return (t->t_affinity & ((uint32_t)1 << c->c_number)) != 0;
+}
+
+static
+bool
+thread_cache_warm(const struct thread *t, const struct cpu *c)
+{
+	return t->t_lastcpu == c &&
+		c->c_hardclocks - t->t_lastrun <= CACHE_WARM_HARDCLOCKS;
+}
+
+/*
+ * Choose a cpu for a thread that is about to become runnable (a
+ * newly forked thread or one being woken up), in order of preference:
+ *
+ *    - the cpu it last ran on, if its cache there is still warm and
+ *      nothing else is waiting to run there;
+ *    - an idle cpu, trying the one it was on first;
+ *    - the cpu it was on, to keep what locality we can;
+ *    - the cpu with the shortest run queue.
+ *
+ * Cpus outside the thread's affinity mask are never chosen. The run
+ * queue lengths and idle flags are read without locks; this is only
+ * a placement heuristic.
+ */
+static
+struct cpu *
+thread_choose_cpu(struct thread *t)
+{
+	struct cpu *last, *c, *best;
+	unsigned i, numcpus;
+
+	last = t->t_cpu;
+	if (thread_cpu_allowed(t, last)) {
+		if (last->c_isidle ||
+		    (thread_cache_warm(t, last) &&
+		     threadlist_isempty(&last->c_runqueue))) {
+			return last;
+		}
+	}
+
+	best = NULL;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (!thread_cpu_allowed(t, c)) {
+			continue;
+		}
+		if (c->c_isidle) {
+			return c;
+		}
+		if (best == NULL ||
+		    c->c_runqueue.tl_count < best->c_runqueue.tl_count) {
+			best = c;
+		}
+	}
+
+	if (thread_cpu_allowed(t, last)) {
+		return last;
+	}
+	KASSERT(best != NULL);
+	return best;
+}
+
+/*
+ * Pick the cpu a thread should be made runnable on, with
+ * thread_choose_cpu.
+ *
+ * A thread can only be moved to a different cpu once the one it was
+ * on is off its stack. A thread that went to sleep gets on the wait
+ * channel while its cpu holds its runqueue lock, and that lock isn't
+ * released until the switch is complete, so taking the lock once
+ * waits out the switch. The exception is the idle loop, which drops
+ * the lock while still on the stack of the thread that slept and
+ * leaves it as curthread (see the notes in thread_consider_migration);
+ * such a thread stays put.
+ */
+static
+struct cpu *
+thread_place(struct thread *t)
+{
+	struct cpu *last, *c;
+	bool busy;
+
+	last = t->t_cpu;
+	c = thread_choose_cpu(t);
+	if (c == last) {
+		return last;
+	}
+
+	spinlock_acquire(&last->c_runqueue_lock);
+	busy = (t == last->c_curthread);
+	spinlock_release(&last->c_runqueue_lock);
+
+	/*
+	 * A thread never sleeps on a cpu its mask forbids: when the
+	 * mask changes, thread_switch moves it off before anything
+	 * else (see thread_setaffinity). So staying put is allowed.
+	 */
+	KASSERT(!busy || thread_cpu_allowed(t, last));
+	return busy ? last : c;
+}
+
+/*
+ * Return the level a thread is scheduled at, taking priority
+ * inheritance into account.
+ */
+unsigned
+thread_priority(const struct thread *t)
+{
+	unsigned pri;
+
+	if (t->t_policy == SCHED_OTHER) {
+		pri = THREAD_RT_LEVELS + t->t_priority;
+	}
+	else {
+		pri = t->t_rtprio;
+	}
+	return t->t_inherit < pri ? t->t_inherit : pri;
+}
+
+/*
+ * Put a thread on a cpu's run queue.
+ *
+ * The run queue is kept sorted by level (see thread_priority),
+ * highest priority first, and FIFO within each level; so the thread
+ * goes after everything at its own level or above. Search from the
+ * tail, since that's where most insertions end up.
+ */
+static
+void
+thread_runqueue_add(struct cpu *c, struct thread *t)
+{
+	struct thread *prev;
+	unsigned pri;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	pri = thread_priority(t);
+	THREADLIST_FORALL_REV(prev, c->c_runqueue) {
+		if (thread_priority(prev) <= pri) {
+			threadlist_insertafter(&c->c_runqueue, prev, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
 /*
  * Make a thread runnable.
  *
@@ -469,12 +851,15 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	target->t_readystamp = targetcpu->c_hardclocks;
+	thread_runqueue_add(targetcpu, target);
 
-	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
+	if (targetcpu->c_isidle && targetcpu != curcpu->c_self &&
+	    targetcpu->c_runqueue.tl_count == 1) {
 		/*
 		 * Other processor is idle; send interrupt to make
-		 * sure it unidles.
+		 * sure it unidles. If there was already something
+		 * on its run queue, it's been sent one already.
 		 */
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
@@ -484,6 +869,86 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+/*
+ * Work stealing.
+ *
+ * Called from the idle loop in thread_switch, without any runqueue
+ * lock held, when the current cpu has nothing to run. Pick the
+ * sibling with the longest run queue and take the thread at the head
+ * of it, which is the one that has been waiting longest at the
+ * highest MLFQ level, onto our own run queue. Returns true if a
+ * thread was moved.
+ *
+ * The queue lengths are read without locking; that's only used to
+ * choose a victim, and is checked again once its lock is held. Only
+ * one runqueue lock is ever held at a time.
+ *
+ * Cpus that are themselves idle are left alone: anything on their
+ * queue was put there since they went idle, and they've been sent an
+ * IPI_UNIDLE to come and run it.
+ */
+static
+bool
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct thread *t;
+	unsigned i, numcpus, count, best;
+
+	victim = NULL;
+	best = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self || c->c_isidle) {
+			continue;
+		}
+		count = c->c_runqueue.tl_count;
+		if (count > best) {
+			best = count;
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return false;
+	}
+
+	t = NULL;
+	spinlock_acquire(&victim->c_runqueue_lock);
+	if (!victim->c_isidle) {
+		/*
+		 * Skip the victim's curthread if it's on its own run
+		 * queue (see the notes in thread_consider_migration),
+		 * and anything not allowed to run here.
+		 */
+		THREADLIST_FORALL(t, victim->c_runqueue) {
+			if (t != victim->c_curthread &&
+			    thread_cpu_allowed(t, curcpu->c_self)) {
+				break;
+			}
+		}
+		if (t != NULL) {
+			threadlist_remove(&victim->c_runqueue, t);
+			t->t_intransit = true;
+		}
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+
+	if (t == NULL) {
+		return false;
+	}
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	t->t_cpu = curcpu->c_self;
+	thread_runqueue_add(curcpu->c_self, t);
+	t->t_intransit = false;
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+	      t->t_name, victim->c_number, curcpu->c_number);
+	return true;
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -508,13 +973,15 @@ thread_fork(const char *name,
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
+	/* Allocate a stack, unless we got one from the thread pool */
 	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -522,6 +989,10 @@ thread_fork(const char *name,
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_affinity = curthread->t_affinity;
+	newthread->t_policy = curthread->t_policy;
+	newthread->t_rtprio = curthread->t_rtprio;
+	newthread->t_cpu = thread_place(newthread);
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -550,6 +1021,86 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * Finish moving a thread whose affinity mask sent it away from this
+ * cpu when it last yielded (see thread_switch). Called after the
+ * switch, when we are no longer running on its stack.
+ */
+static
+void
+thread_finish_move(void)
+{
+	struct thread *t;
+
+	t = curcpu->c_moving;
+	if (t == NULL) {
+		return;
+	}
+	curcpu->c_moving = NULL;
+
+	KASSERT(t != curthread);
+	t->t_cpu = thread_place(t);
+	thread_make_runnable(t, false);
+}
+
+/*
+ * Set the current thread's affinity mask.
+ */
+int
+thread_setaffinity(uint32_t mask)
+{
+	unsigned numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus < 32) {
+		mask &= ((uint32_t)1 << numcpus) - 1;
+	}
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	curthread->t_affinity = mask;
+	if (!thread_cpu_allowed(curthread, curcpu->c_self)) {
+		/* thread_switch moves us off, even with nothing else to run. */
+		thread_yield();
+	}
+	KASSERT(thread_cpu_allowed(curthread, curcpu->c_self));
+	return 0;
+}
+
+/*
+ * Change the current thread's scheduling class.
+ */
+int
+thread_setsched(int policy, unsigned rtprio)
+{
+	switch (policy) {
+	    case SCHED_OTHER:
+		rtprio = 0;
+		break;
+	    case SCHED_FIFO:
+	    case SCHED_RR:
+		if (rtprio >= THREAD_RT_LEVELS) {
+			return EINVAL;
+		}
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	curthread->t_policy = policy;
+	curthread->t_rtprio = rtprio;
+	curthread->t_ticks = 0;
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	if (policy == SCHED_OTHER) {
+		/* Let anything we were keeping out run. */
+		thread_yield();
+	}
+	return 0;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -575,6 +1126,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 
 	cur = curthread;
 
+	/* RCU read sections may not sleep or yield. */
+	KASSERT(cur->t_rcu_depth == 0);
+
 	/*
 	 * If we're idle, return without doing anything. This happens
 	 * when the timer interrupt interrupts the idle loop.
@@ -590,19 +1144,59 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. But a
+	 * thread that isn't allowed on this cpu any more has to go
+	 * regardless, and the idle thread is here to get to the idle
+	 * loop.
+	 */
+	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue) &&
+	    cur != curcpu->c_idlethread &&
+	    thread_cpu_allowed(cur, curcpu->c_self)) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
 	}
 
+	/* Count the switch. */
+	if (cur == curcpu->c_idlethread) {
+		/* not a real thread */
+	}
+	else if (newstate == S_READY && cur->t_in_interrupt) {
+		cur->t_stats.ts_nivcsw++;
+		curcpu->c_stats.cs_nivcsw++;
+	}
+	else if (newstate != S_ZOMBIE) {
+		cur->t_stats.ts_nvcsw++;
+		curcpu->c_stats.cs_nvcsw++;
+		if (newstate == S_SLEEP) {
+			cur->t_stats.ts_nsleeps++;
+		}
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
-		thread_make_runnable(cur, true /*have lock*/);
+		if (cur == curcpu->c_idlethread) {
+			/* Never queued; see thread_idle. */
+		}
+		else if (thread_cpu_allowed(cur, curcpu->c_self)) {
+			thread_make_runnable(cur, true /*have lock*/);
+		}
+		else {
+			/*
+			 * Its affinity mask says it should go to
+			 * another cpu. It can't be put on that cpu's
+			 * run queue until we're off its stack, so
+			 * leave it for thread_finish_move. (If there's
+			 * nothing else to run, we switch to the idle
+			 * thread below rather than idle on its stack.)
+			 */
+			KASSERT(curcpu->c_moving == NULL);
+			curcpu->c_moving = cur;
+		}
 		break;
 	    case S_SLEEP:
 		cur->t_wchan_name = wc->wc_name;
@@ -641,17 +1235,65 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * lock to look at it, this should not be visible or matter.
 	 */
 
-	/* The current cpu is now idle. */
-	curcpu->c_isidle = true;
-	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
-		if (next == NULL) {
-			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
-			spinlock_acquire(&curcpu->c_runqueue_lock);
-		}
-	} while (next == NULL);
-	curcpu->c_isidle = false;
+	/*
+	 * Before actually idling, try to pull a thread over from a
+	 * busier cpu (see thread_steal). If that fails, idle until an
+	 * interrupt comes in; every wakeup, including the timer, comes
+	 * back through here and tries again.
+	 */
+
+	/*
+	 * A thread leaving this cpu can't be sent off while we're on
+	 * its stack, and the idle loop would keep us there; so if
+	 * there's nothing else to run, run the idle thread, which
+	 * idles on its own stack.
+	 */
+	if (curcpu->c_moving != NULL &&
+	    threadlist_isempty(&curcpu->c_runqueue)) {
+		next = curcpu->c_idlethread;
+	}
+	else {
+		/* The current cpu is now idle. */
+		curcpu->c_isidle = true;
+		do {
+			next = threadlist_remhead(&curcpu->c_runqueue);
+			if (next == NULL) {
+				spinlock_release(&curcpu->c_runqueue_lock);
+				/* An idle cpu is quiescent for RCU. */
+				rcu_quiescent();
+				if (curcpu->c_workq != NULL) {
+					/* Deferred work may wake things. */
+					workq_run();
+				}
+				else if (!thread_steal()) {
+					hardclock_idle_enter();
+					cpu_idle();
+					hardclock_idle_exit(false);
+				}
+				spinlock_acquire(&curcpu->c_runqueue_lock);
+			}
+		} while (next == NULL);
+		curcpu->c_isidle = false;
+		KASSERT(thread_cpu_allowed(next, curcpu->c_self));
+	}
+
+	/*
+	 * Charge NEXT for its time on the run queue. The stamp may be
+	 * from another cpu, whose count can be a little ahead.
+	 */
+	if (curcpu->c_hardclocks - next->t_readystamp < (unsigned)-1 / 2) {
+		next->t_stats.ts_waitticks +=
+			curcpu->c_hardclocks - next->t_readystamp;
+	}
+	if (next->t_lastcpu != NULL && next->t_lastcpu != curcpu->c_self) {
+		curcpu->c_stats.cs_migrations++;
+	}
+
+	TRACE(TRC_SCHED, TRE_SWITCH, (uintptr_t)next, newstate);
+
+	/* Remember where and when we stopped, for thread_place. */
+	cur->t_lastcpu = curcpu->c_self;
+	cur->t_lastrun = curcpu->c_hardclocks;
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -720,6 +1362,12 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send off any thread that was leaving this cpu. */
+	thread_finish_move();
+
+	/* We switched, so this cpu is in an RCU quiescent state. */
+	rcu_quiescent();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -753,6 +1401,12 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send off any thread that was leaving this cpu. */
+	thread_finish_move();
+
+	/* We switched, so this cpu is in an RCU quiescent state. */
+	rcu_quiescent();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -818,20 +1472,145 @@ thread_yield(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Timer tick.
+ *
+ * This is called from hardclock() on every tick. The current thread
+ * is charged for the tick; once it has used up the quantum for its
+ * MLFQ level it is demoted and yields. It also yields early if a
+ * thread at a higher level is waiting, e.g. one just woken up. A
+ * thread is not otherwise preempted by threads at its own level
+ * until its quantum runs out. Real-time threads are never demoted;
+ * SCHED_RR ones yield every RT_QUANTUM ticks and SCHED_FIFO ones
+ * only give way to more urgent threads.
+ */
+void
+thread_tick(void)
+{
+	struct thread *cur, *next;
+	bool preempt;
+
+	/* Nothing to charge while the idle loop is running. */
+	if (curcpu->c_isidle) {
+		return;
+	}
+
+	cur = curthread;
+	switch (cur->t_policy) {
+	    case SCHED_OTHER:
+		cur->t_ticks++;
+		if (cur->t_ticks >= mlfq_quantum[cur->t_priority]) {
+			if (cur->t_priority < MLFQ_LEVELS - 1) {
+				cur->t_priority++;
+			}
+			cur->t_ticks = 0;
+			thread_yield();
+			return;
+		}
+		break;
+	    case SCHED_RR:
+		cur->t_ticks++;
+		if (cur->t_ticks >= RT_QUANTUM) {
+			cur->t_ticks = 0;
+			thread_yield();
+			return;
+		}
+		break;
+	    case SCHED_FIFO:
+		break;
+	}
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	next = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+	preempt = (next != NULL &&
+		   thread_priority(next) < thread_priority(cur));
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	if (preempt) {
+		thread_yield();
+	}
+}
+
 /*
  * Scheduler.
  *
  * This is called periodically from hardclock(). It should reshuffle
  * the current CPU's run queue by job priority.
+ *
+ * Demotion happens in thread_tick() and promotion on wakeup; what's
+ * left for here is starvation avoidance. Threads that stay CPU-bound
+ * sink to the lowest MLFQ level and would never run while anything
+ * interactive is around, so every so often put everything on this
+ * cpu back at the top level. Since that gives every thread the same
+ * level, the run queue stays sorted.
  */
-
 void
 schedule(void)
 {
+	struct thread *t;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	THREADLIST_FORALL(t, curcpu->c_runqueue) {
+		t->t_priority = 0;
+		t->t_ticks = 0;
+	}
+	curthread->t_priority = 0;
+	curthread->t_ticks = 0;
+	spinlock_release(&curcpu->c_runqueue_lock);
+}
+
+/*
+ * Set the level T inherits through the locks it holds. This is
+ * called from the lock code with T possibly running, asleep, or
+ * waiting on some cpu's run queue; in the last case it has to be
+ * moved to keep the run queue sorted.
+ */
+void
+thread_inherit(struct thread *t, unsigned pri)
+{
+	struct cpu *c;
+	bool queued;
+
+	/*
+	 * Lock the run queue of the cpu T belongs to. If T has been
+	 * taken off a run queue by thread_steal or
+	 * thread_consider_migration and not yet put on the next one,
+	 * it belongs to neither; wait for it to land.
+	 */
+	while (1) {
+		c = t->t_cpu;
+		if (c == NULL) {
+			/* not started yet */
+			t->t_inherit = pri;
+			return;
+		}
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (t->t_cpu == c && !t->t_intransit) {
+			break;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
 	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
+	 * A sleeping thread's t_cpu is changed by whoever wakes it,
+	 * before it takes the new cpu's run queue lock and marks the
+	 * thread ready. So check the state first and then that t_cpu
+	 * still matches; if both hold, T is on C's run queue (unless
+	 * it is running or being handed to another cpu).
 	 */
+	queued = (t->t_state == S_READY);
+	membar_load_load();
+	queued = queued && t->t_cpu == c &&
+		t != c->c_curthread && t != c->c_moving;
+
+	if (queued) {
+		threadlist_remove(&c->c_runqueue, t);
+	}
+	t->t_inherit = pri;
+	if (queued) {
+		thread_runqueue_add(c, t);
+	}
+	spinlock_release(&c->c_runqueue_lock);
 }
 
 /*
@@ -858,18 +1637,21 @@ thread_consider_migration(void)
 	unsigned i, numcpus;
 	struct cpu *c;
 	struct threadlist victims;
-	struct thread *t;
+	struct thread *t, *prev;
 
+	/*
+	 * The counts are only a hint (they can change as soon as we
+	 * look away anyway) so don't bother locking every cpu's run
+	 * queue to read them.
+	 */
 	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
 		total_count += c->c_runqueue.tl_count;
 		if (c == curcpu->c_self) {
 			my_count = c->c_runqueue.tl_count;
 		}
-		spinlock_release(&c->c_runqueue_lock);
 	}
 
 	one_share = DIVROUNDUP(total_count, numcpus);
@@ -877,13 +1659,28 @@ thread_consider_migration(void)
 		return;
 	}
 
+	/*
+	 * Choose victims from the tail of the run queue, passing over
+	 * threads that only just stopped running here and probably
+	 * still have a warm cache. (Idle cpus may also have stolen
+	 * some threads in the meantime, so we may come up short.)
+	 */
 	to_send = my_count - one_share;
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	i = 0;
+	t = curcpu->c_runqueue.tl_tail.tln_prev->tln_self;
+	while (i < to_send && t != NULL) {
+		prev = t->t_listnode.tln_prev->tln_self;
+		if (!thread_cache_warm(t, curcpu->c_self)) {
+			threadlist_remove(&curcpu->c_runqueue, t);
+			t->t_intransit = true;
+			threadlist_addhead(&victims, t);
+			i++;
+		}
+		t = prev;
 	}
+	to_send = i;
 	spinlock_release(&curcpu->c_runqueue_lock);
 
 	for (i=0; i < numcpus && to_send > 0; i++) {
@@ -922,8 +1719,19 @@ thread_consider_migration(void)
 				continue;
 			}
 
+			/*
+			 * Likewise skip threads whose affinity mask
+			 * doesn't allow them on this cpu.
+			 */
+			if (!thread_cpu_allowed(t, c)) {
+				threadlist_addtail(&victims, t);
+				to_send--;
+				continue;
+			}
+
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_runqueue_add(c, t);
+			t->t_intransit = false;
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -947,7 +1755,8 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_runqueue_add(curcpu->c_self, t);
+			t->t_intransit = false;
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -958,6 +1767,65 @@ thread_consider_migration(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Accounting
+ */
+
+/*
+ * Add one set of counters into another.
+ */
+void
+threadstats_add(struct threadstats *to, const struct threadstats *from)
+{
+	to->ts_uticks += from->ts_uticks;
+	to->ts_sticks += from->ts_sticks;
+	to->ts_waitticks += from->ts_waitticks;
+	to->ts_nsleeps += from->ts_nsleeps;
+	to->ts_nvcsw += from->ts_nvcsw;
+	to->ts_nivcsw += from->ts_nivcsw;
+}
+
+/*
+ * Print the per-cpu counters, and the totals for the kernel process
+ * (which includes every thread that has exited, since exiting
+ * threads finish up there).
+ *
+ * The counters are read without locking, so a busy system may show
+ * a line that's slightly out of step with itself.
+ */
+void
+thread_printstats(void)
+{
+	const struct cpustats *cs;
+	struct threadstats ts;
+	unsigned i, numcpus, total, util, rqlen;
+
+	kprintf("cpu   busy   idle util    vcsw   ivcsw  migr "
+		"ipi-out  ipi-in  runq\n");
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		cs = &cpuarray_get(&allcpus, i)->c_stats;
+		total = cs->cs_busyticks + cs->cs_idleticks;
+		util = total == 0 ? 0 : (100 * cs->cs_busyticks) / total;
+		/* average run queue length, in hundredths */
+		rqlen = cs->cs_rqsamples == 0 ? 0 :
+			(unsigned)((100 * cs->cs_rqsum) / cs->cs_rqsamples);
+		kprintf("%3u %6u %6u %3u%% %7u %7u %5u %7u %7u %2u.%02u\n",
+			i, cs->cs_busyticks, cs->cs_idleticks, util,
+			cs->cs_nvcsw, cs->cs_nivcsw, cs->cs_migrations,
+			cs->cs_ipisent, cs->cs_ipirecv,
+			rqlen / 100, rqlen % 100);
+	}
+
+	proc_getstats(kproc, false, &ts);
+	kprintf("kernel process: %u user ticks, %u system ticks, "
+		"%u waiting\n", ts.ts_uticks, ts.ts_sticks, ts.ts_waitticks);
+	kprintf("    %u sleeps, %u voluntary and %u involuntary switches\n",
+		ts.ts_nsleeps, ts.ts_nvcsw, ts.ts_nivcsw);
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Wait channel functions
  */
@@ -1019,6 +1887,21 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	spinlock_acquire(lk);
 }
 
+/*
+ * Adjust the MLFQ level of a thread being woken up from a wait
+ * channel. A thread that blocks before its quantum runs out is
+ * interactive or I/O-bound, so move it up a level.
+ */
+static
+void
+thread_wakeup_boost(struct thread *target)
+{
+	if (target->t_priority > 0) {
+		target->t_priority--;
+	}
+	target->t_ticks = 0;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1045,6 +1928,8 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 * in thread_switch.
 	 */
 
+	thread_wakeup_boost(target);
+	target->t_cpu = thread_place(target);
 	thread_make_runnable(target, false);
 }
 
@@ -1075,12 +1960,36 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		thread_wakeup_boost(target);
+		target->t_cpu = thread_place(target);
 		thread_make_runnable(target, false);
 	}
 
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Move one thread sleeping on wait channel FROM to wait channel TO,
+ * without waking it up. Both channels must be protected by the same
+ * spinlock LK, which must be held. Returns the thread moved, or NULL
+ * if nobody was sleeping on FROM.
+ */
+struct thread *
+wchan_moveone(struct wchan *from, struct wchan *to, struct spinlock *lk)
+{
+	struct thread *target;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	target = threadlist_remhead(&from->wc_threads);
+	if (target == NULL) {
+		return NULL;
+	}
+	target->t_wchan_name = to->wc_name;
+	threadlist_addtail(&to->wc_threads, target);
+	return target;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1113,6 +2022,7 @@ ipi_send(struct cpu *target, int code)
 	spinlock_acquire(&target->c_ipi_lock);
 	target->c_ipi_pending |= (uint32_t)1 << code;
 	mainbus_send_ipi(target);
+	curcpu->c_stats.cs_ipisent++;
 	spinlock_release(&target->c_ipi_lock);
 }
 
@@ -1178,6 +2088,7 @@ interprocessor_interrupt(void)
 
 	spinlock_acquire(&curcpu->c_ipi_lock);
 	bits = curcpu->c_ipi_pending;
+	curcpu->c_stats.cs_ipirecv++;
 
 	if (bits & (1U << IPI_PANIC)) {
 		/* panic on another cpu - just stop dead */
@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Timeouts, kept on a per-cpu hierarchical timer wheel.
+ *
+ * The wheel has three levels. Level 0 has one slot per tick for the
+ * next TW_SIZE0 ticks; each slot of level 1 covers TW_SIZE0 ticks,
+ * and each slot of level 2 covers a whole revolution of level 1. A
+ * timeout goes in the slot for its expiry time at the lowest level
+ * that can hold it, so arming it is just a list insert and cancelling
+ * it a list remove. Every time level 0 wraps around, the next slot of
+ * level 1 is emptied and its timeouts re-sorted into level 0 (and
+ * likewise for level 2 into level 1), so each timeout is moved at
+ * most twice before it fires.
+ *
+ * The wheel's clock is the cpu's c_hardclocks count.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <timeout.h>
+
+#define TW_BITS0	8
+#define TW_BITS		6
+#define TW_SIZE0	(1U << TW_BITS0)
+#define TW_SIZE		(1U << TW_BITS)
+#define TW_MASK0	(TW_SIZE0 - 1)
+#define TW_MASK		(TW_SIZE - 1)
+
+/* Ticks covered by levels 0-1 and by levels 0-2. */
+#define TW_SPAN1	(TW_SIZE0 << TW_BITS)
+#define TW_SPAN2	(TW_SPAN1 << TW_BITS)
+
+#define TW_INDEX1(t)	(((t) >> TW_BITS0) & TW_MASK)
+#define TW_INDEX2(t)	(((t) >> (TW_BITS0 + TW_BITS)) & TW_MASK)
+
+struct timerwheel {
+	struct spinlock tw_lock;
+	struct timeout *tw_level0[TW_SIZE0];
+	struct timeout *tw_level1[TW_SIZE];
+	struct timeout *tw_level2[TW_SIZE];
+};
+
+/*
+ * Create a cpu's timer wheel.
+ */
+struct timerwheel *
+timerwheel_create(void)
+{
+	struct timerwheel *tw;
+	unsigned i;
+
+	tw = kmalloc(sizeof(*tw));
+	if (tw == NULL) {
+		return NULL;
+	}
+	spinlock_init(&tw->tw_lock);
+	for (i=0; i<TW_SIZE0; i++) {
+		tw->tw_level0[i] = NULL;
+	}
+	for (i=0; i<TW_SIZE; i++) {
+		tw->tw_level1[i] = NULL;
+		tw->tw_level2[i] = NULL;
+	}
+	return tw;
+}
+
+/*
+ * Put a timeout in the right slot of a wheel whose clock reads NOW.
+ */
+static
+void
+timerwheel_insert(struct timerwheel *tw, struct timeout *to, unsigned now)
+{
+	struct timeout **slot;
+	unsigned delta;
+
+	KASSERT(spinlock_do_i_hold(&tw->tw_lock));
+
+	delta = to->to_expire - now;
+	if (delta < TW_SIZE0) {
+		slot = &tw->tw_level0[to->to_expire & TW_MASK0];
+	}
+	else if (delta < TW_SPAN1) {
+		slot = &tw->tw_level1[TW_INDEX1(to->to_expire)];
+	}
+	else if (delta < TW_SPAN2) {
+		slot = &tw->tw_level2[TW_INDEX2(to->to_expire)];
+	}
+	else {
+		/*
+		 * Too far off for the wheel. Park it in the level 2
+		 * slot that will be looked at last; it gets
+		 * re-sorted from there.
+		 */
+		slot = &tw->tw_level2[(TW_INDEX2(now) - 1) & TW_MASK];
+	}
+
+	to->to_next = *slot;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = &to->to_next;
+	}
+	*slot = to;
+	to->to_pprev = slot;
+}
+
+/*
+ * Take a timeout off whatever slot it's in.
+ */
+static
+void
+timerwheel_remove(struct timeout *to)
+{
+	*to->to_pprev = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = to->to_pprev;
+	}
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+}
+
+/*
+ * Re-sort the timeouts in a slot of a higher level.
+ */
+static
+void
+timerwheel_cascade(struct timerwheel *tw, struct timeout **slot,
+		   unsigned now)
+{
+	struct timeout *to, *next;
+
+	to = *slot;
+	*slot = NULL;
+	while (to != NULL) {
+		next = to->to_next;
+		timerwheel_insert(tw, to, now);
+		to = next;
+	}
+}
+
+void
+timeout(struct timeout *to, unsigned ticks,
+	void (*func)(void *), void *data)
+{
+	struct timerwheel *tw;
+	unsigned now;
+	int spl;
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+
+	to->to_func = func;
+	to->to_data = data;
+
+	/*
+	 * Block interrupts before looking at curcpu so we stay on
+	 * this cpu until the timeout is on its wheel.
+	 */
+	spl = splhigh();
+	tw = curcpu->c_timers;
+	spinlock_acquire(&tw->tw_lock);
+	now = curcpu->c_hardclocks;
+	to->to_cpu = curcpu->c_self;
+	to->to_expire = now + ticks;
+	timerwheel_insert(tw, to, now);
+	spinlock_release(&tw->tw_lock);
+	splx(spl);
+}
+
+bool
+untimeout(struct timeout *to)
+{
+	struct timerwheel *tw;
+	bool pending;
+
+	if (to->to_cpu == NULL) {
+		/* never armed */
+		return false;
+	}
+	tw = to->to_cpu->c_timers;
+	spinlock_acquire(&tw->tw_lock);
+	pending = (to->to_pprev != NULL);
+	if (pending) {
+		timerwheel_remove(to);
+	}
+	spinlock_release(&tw->tw_lock);
+	return pending;
+}
+
+bool
+timeout_pending(struct timeout *to)
+{
+	return to->to_cpu != NULL && to->to_pprev != NULL;
+}
+
+/*
+ * Return how many ticks from now the current cpu's wheel next needs
+ * to be advanced, at most MAX: either a timeout comes due, or level 0
+ * wraps around and the higher levels have to be cascaded.
+ */
+unsigned
+timeout_nextdue(unsigned max)
+{
+	struct timerwheel *tw;
+	unsigned now, i, t;
+
+	KASSERT(max > 0 && max < TW_SIZE0);
+
+	tw = curcpu->c_timers;
+	spinlock_acquire(&tw->tw_lock);
+	now = curcpu->c_hardclocks;
+	for (i=1; i<max; i++) {
+		t = now + i;
+		if ((t & TW_MASK0) == 0 || tw->tw_level0[t & TW_MASK0] != NULL) {
+			break;
+		}
+	}
+	spinlock_release(&tw->tw_lock);
+	return i;
+}
+
+/*
+ * Advance the current cpu's wheel to the current value of
+ * c_hardclocks, and run whatever has come due. Called from
+ * hardclock() after bumping c_hardclocks.
+ */
+void
+timeout_hardclock(void)
+{
+	struct timerwheel *tw;
+	struct timeout *to, *next, *due;
+	unsigned now;
+
+	tw = curcpu->c_timers;
+	now = curcpu->c_hardclocks;
+
+	spinlock_acquire(&tw->tw_lock);
+	if ((now & TW_MASK0) == 0) {
+		if (TW_INDEX1(now) == 0) {
+			timerwheel_cascade(tw, &tw->tw_level2[TW_INDEX2(now)],
+					   now);
+		}
+		timerwheel_cascade(tw, &tw->tw_level1[TW_INDEX1(now)], now);
+	}
+
+	/* Everything in this level 0 slot is due now. */
+	due = tw->tw_level0[now & TW_MASK0];
+	tw->tw_level0[now & TW_MASK0] = NULL;
+	for (to = due; to != NULL; to = to->to_next) {
+		KASSERT(to->to_expire == now);
+		to->to_pprev = NULL;
+	}
+	spinlock_release(&tw->tw_lock);
+
+	/* Run the callbacks without the lock, so they can rearm. */
+	for (to = due; to != NULL; to = next) {
+		next = to->to_next;
+		to->to_next = NULL;
+		to->to_func(to->to_data);
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Sleeping for a number of ticks.
+ *
+ * Sleepers wait on one of a small set of wait channels chosen by
+ * hashing the thread, as in traditional Unix sleep queues, and each
+ * checks its own flag on wakeup; this avoids having to create a wait
+ * channel per sleep.
+ */
+
+#define TSLEEP_BUCKETS 16
+
+static struct {
+	struct wchan *tb_wchan;
+	struct spinlock tb_lock;
+} tsleep_buckets[TSLEEP_BUCKETS];
+
+struct tsleeper {
+	unsigned ts_bucket;
+	volatile bool ts_done;
+};
+
+void
+timeout_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<TSLEEP_BUCKETS; i++) {
+		tsleep_buckets[i].tb_wchan = wchan_create("tsleep");
+		if (tsleep_buckets[i].tb_wchan == NULL) {
+			panic("timeout_bootstrap: Out of memory\n");
+		}
+		spinlock_init(&tsleep_buckets[i].tb_lock);
+	}
+}
+
+static
+void
+timeout_wakeup(void *data)
+{
+	struct tsleeper *ts = data;
+	unsigned b = ts->ts_bucket;
+
+	spinlock_acquire(&tsleep_buckets[b].tb_lock);
+	ts->ts_done = true;
+	wchan_wakeall(tsleep_buckets[b].tb_wchan, &tsleep_buckets[b].tb_lock);
+	spinlock_release(&tsleep_buckets[b].tb_lock);
+}
+
+void
+timeout_sleep(unsigned ticks)
+{
+	struct timeout to;
+	struct tsleeper ts;
+	unsigned b;
+
+	b = ((uintptr_t)curthread / sizeof(struct thread)) % TSLEEP_BUCKETS;
+	ts.ts_bucket = b;
+	ts.ts_done = false;
+
+	spinlock_acquire(&tsleep_buckets[b].tb_lock);
+	timeout(&to, ticks, timeout_wakeup, &ts);
+	while (!ts.ts_done) {
+		wchan_sleep(tsleep_buckets[b].tb_wchan,
+			    &tsleep_buckets[b].tb_lock);
+	}
+	spinlock_release(&tsleep_buckets[b].tb_lock);
+}
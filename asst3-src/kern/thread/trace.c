@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Kernel event tracing.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <spl.h>
+#include <membar.h>
+#include <clock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <trace.h>
+
+#define TRACE_NRECS	1024	/* Records per cpu */
+
+/*
+ * A cpu's ring buffer. tb_next counts every record ever written;
+ * the latest TRACE_NRECS of them are in tb_recs, at tb_next modulo
+ * TRACE_NRECS. Only the owning cpu writes, with interrupts off.
+ */
+struct tracebuf {
+	unsigned tb_next;
+	struct tracerec tb_recs[TRACE_NRECS];
+};
+
+volatile unsigned trace_mask;
+
+static const struct {
+	const char *name;
+	unsigned mask;
+} trace_categories[] = {
+	{ "sched",	TRC_SCHED },
+	{ "vm",		TRC_VM },
+	{ "syscall",	TRC_SYSCALL },
+	{ "disk",	TRC_DISK },
+	{ "lock",	TRC_LOCK },
+	{ "all",	TRC_ALL },
+};
+#define TRACE_NCATEGORIES \
+	(sizeof(trace_categories) / sizeof(trace_categories[0]))
+
+/*
+ * How to print each event. The format gets the two arguments.
+ */
+static const struct {
+	const char *name;
+	const char *fmt;
+} trace_events[TRE_NEVENTS] = {
+	[TRE_SWITCH] =		{ "switch",   "to 0x%x, was state %u" },
+	[TRE_VMFAULT] =		{ "vmfault",  "addr 0x%x, type %u" },
+	[TRE_SYSCALL] =		{ "syscall",  "call %u, pid %u" },
+	[TRE_SYSRET] =		{ "sysret",   "call %u, error %u" },
+	[TRE_SFSIO] =		{ "sfsio",    "block %u, %u" },
+	[TRE_DISKIO] =		{ "diskio",   "sector %u, %u" },
+	[TRE_DISKDONE] =	{ "diskdone", "sector %u, error %u" },
+	[TRE_LOCK] =		{ "lock",     "0x%x, waited %u" },
+};
+
+/*
+ * Record an event on the current cpu. Tracing may have been turned
+ * on before this cpu got a buffer; if so, drop the event.
+ */
+void
+trace_record(unsigned event, uint32_t a, uint32_t b)
+{
+	struct tracebuf *tb;
+	struct tracerec *tr;
+	struct timespec ts;
+	int spl;
+
+	spl = splhigh();
+	tb = curcpu->c_trace;
+	if (tb != NULL) {
+		gettime(&ts);
+		tr = &tb->tb_recs[tb->tb_next % TRACE_NRECS];
+		tb->tb_next++;
+		tr->tr_sec = ts.tv_sec;
+		tr->tr_nsec = ts.tv_nsec;
+		tr->tr_thread = curthread;
+		tr->tr_event = event;
+		tr->tr_a = a;
+		tr->tr_b = b;
+	}
+	splx(spl);
+}
+
+unsigned
+trace_category(const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<TRACE_NCATEGORIES; i++) {
+		if (!strcmp(name, trace_categories[i].name)) {
+			return trace_categories[i].mask;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Turn on the categories in MASK. Buffers are allocated the first
+ * time and kept, so that a dump after turning tracing off still has
+ * something to show.
+ */
+int
+trace_enable(unsigned mask)
+{
+	struct tracebuf *tb;
+	struct cpu *c;
+	unsigned i, numcpus;
+
+	numcpus = cpu_count();
+	for (i=0; i<numcpus; i++) {
+		c = cpu_get(i);
+		if (c->c_trace != NULL) {
+			continue;
+		}
+		tb = kmalloc(sizeof(*tb));
+		if (tb == NULL) {
+			return ENOMEM;
+		}
+		tb->tb_next = 0;
+		/* Make sure the cpu sees it initialized. */
+		membar_store_store();
+		c->c_trace = tb;
+	}
+
+	trace_mask |= mask;
+	return 0;
+}
+
+void
+trace_disable(void)
+{
+	trace_mask = 0;
+}
+
+/*
+ * Empty the buffers. Tracing should be off, or records written at
+ * the same time may be lost or show up half-written.
+ */
+void
+trace_clear(void)
+{
+	struct tracebuf *tb;
+	unsigned i, numcpus;
+
+	numcpus = cpu_count();
+	for (i=0; i<numcpus; i++) {
+		tb = cpu_get(i)->c_trace;
+		if (tb != NULL) {
+			tb->tb_next = 0;
+		}
+	}
+}
+
+/*
+ * Return true if record A is earlier than record B.
+ */
+static
+bool
+trace_before(const struct tracerec *a, const struct tracerec *b)
+{
+	if (a->tr_sec != b->tr_sec) {
+		return a->tr_sec < b->tr_sec;
+	}
+	return a->tr_nsec < b->tr_nsec;
+}
+
+static
+void
+trace_print(unsigned cpunum, const struct tracerec *tr, bool raw)
+{
+	kprintf("%u.%09u cpu%u %p ", tr->tr_sec, tr->tr_nsec, cpunum,
+		tr->tr_thread);
+	if (raw || tr->tr_event >= TRE_NEVENTS) {
+		kprintf("%08x %08x %08x\n", tr->tr_event, tr->tr_a, tr->tr_b);
+		return;
+	}
+	kprintf("%-8s ", trace_events[tr->tr_event].name);
+	kprintf(trace_events[tr->tr_event].fmt, tr->tr_a, tr->tr_b);
+	kprintf("\n");
+}
+
+/*
+ * Print the buffers, merged in time order. Each cpu's records are
+ * already in order, so repeatedly take the earliest of the records
+ * at the head of each buffer.
+ *
+ * Tracing is suspended for the duration, both so the buffers hold
+ * still and so the printing isn't itself traced.
+ */
+void
+trace_dump(bool raw)
+{
+	struct tracebuf *tb;
+	unsigned *pos, *end;
+	unsigned i, best, numcpus, savedmask, total;
+
+	savedmask = trace_mask;
+	trace_mask = 0;
+
+	numcpus = cpu_count();
+	pos = kmalloc(numcpus * sizeof(*pos));
+	end = kmalloc(numcpus * sizeof(*end));
+	if (pos == NULL || end == NULL) {
+		kfree(pos);
+		kfree(end);
+		kprintf("trace: Out of memory\n");
+		trace_mask = savedmask;
+		return;
+	}
+
+	total = 0;
+	for (i=0; i<numcpus; i++) {
+		tb = cpu_get(i)->c_trace;
+		end[i] = tb == NULL ? 0 : tb->tb_next;
+		pos[i] = end[i] > TRACE_NRECS ? end[i] - TRACE_NRECS : 0;
+		total += end[i] - pos[i];
+	}
+
+	while (total > 0) {
+		best = numcpus;
+		for (i=0; i<numcpus; i++) {
+			if (pos[i] == end[i]) {
+				continue;
+			}
+			tb = cpu_get(i)->c_trace;
+			if (best == numcpus ||
+			    trace_before(&tb->tb_recs[pos[i] % TRACE_NRECS],
+				 &cpu_get(best)->c_trace->tb_recs[
+					 pos[best] % TRACE_NRECS])) {
+				best = i;
+			}
+		}
+		KASSERT(best < numcpus);
+		tb = cpu_get(best)->c_trace;
+		trace_print(best, &tb->tb_recs[pos[best] % TRACE_NRECS], raw);
+		pos[best]++;
+		total--;
+	}
+
+	kfree(pos);
+	kfree(end);
+	trace_mask = savedmask;
+}
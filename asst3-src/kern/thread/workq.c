@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Per-cpu deferred work queues. See workq.h.
+ *
+ * Each cpu has a FIFO list of work items (c_workq in struct cpu)
+ * that is only touched by that cpu with interrupts off, so it needs
+ * no lock. The only cross-cpu state is an item's wi_queued flag,
+ * which is updated atomically so an item can't be put on two queues
+ * at once.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <spl.h>
+#include <membar.h>
+#include <cpu.h>
+#include <current.h>
+#include <workq.h>
+
+void
+workitem_init(struct workitem *wi, void (*func)(void *), void *data)
+{
+	wi->wi_next = NULL;
+	spinlock_data_set(&wi->wi_queued, 0);
+	wi->wi_func = func;
+	wi->wi_data = data;
+}
+
+void
+workq_schedule(struct workitem *wi)
+{
+	int spl;
+
+	/*
+	 * Only the first caller since the item was last taken off a
+	 * queue gets to queue it. (Use fetchinc rather than
+	 * testandset, which can fail spuriously.)
+	 */
+	if (spinlock_data_fetchinc(&wi->wi_queued) != 0) {
+		return;
+	}
+
+	spl = splhigh();
+	wi->wi_next = NULL;
+	*curcpu->c_workq_tail = wi;
+	curcpu->c_workq_tail = &wi->wi_next;
+	splx(spl);
+}
+
+void
+workq_run(void)
+{
+	struct workitem *wi;
+	int spl;
+
+	spl = splhigh();
+	/* Reload curcpu each time; a work function may be preempted. */
+	while ((wi = curcpu->c_workq) != NULL) {
+		curcpu->c_workq = wi->wi_next;
+		if (curcpu->c_workq == NULL) {
+			curcpu->c_workq_tail = &curcpu->c_workq;
+		}
+		wi->wi_next = NULL;
+
+		/*
+		 * Clear the flag before calling the function, so an
+		 * interrupt that arrives while it runs queues it
+		 * again rather than being missed.
+		 */
+		spinlock_data_set(&wi->wi_queued, 0);
+		membar_any_any();
+
+		splx(spl);
+		wi->wi_func(wi->wi_data);
+		spl = splhigh();
+	}
+	splx(spl);
+}
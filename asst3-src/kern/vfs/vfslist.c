@@ -90,6 +90,17 @@ DEFARRAY(knowndev, static __UNUSED inline);
 
 static struct knowndevarray *knowndevs;
 
+/*
+ * Changes to knowndevs (including to the kd_fs of an entry) are made
+ * holding both knowndevs_lock for writing and the big lock, taken in
+ * that order. Readers may hold either one: those that already run
+ * under the big lock (lookups) need nothing more, and those that
+ * don't (sync) take knowndevs_lock for reading so they don't
+ * exclude one another. Nothing may take knowndevs_lock while
+ * holding the big lock.
+ */
+static struct rwlock *knowndevs_lock;
+
 /* The big lock for all FS ops. Remove for filesystem assignment. */
 static struct lock *vfs_biglock;
 static unsigned vfs_biglock_depth;
@@ -105,6 +116,10 @@ vfs_bootstrap(void)
 	if (knowndevs==NULL) {
 		panic("vfs: Could not create knowndevs array\n");
 	}
+	knowndevs_lock = rwlock_create("knowndevs");
+	if (knowndevs_lock==NULL) {
+		panic("vfs: Could not create knowndevs lock\n");
+	}
 
 	vfs_biglock = lock_create("vfs_biglock");
 	if (vfs_biglock==NULL) {
@@ -166,6 +181,26 @@ vfs_biglock_do_i_hold(void)
 	return lock_do_i_hold(vfs_biglock);
 }
 
+/*
+ * Lock knowndevs for changing it; see above.
+ */
+static
+void
+knowndevs_acquire_write(void)
+{
+	KASSERT(!vfs_biglock_do_i_hold());
+	rwlock_acquire_write(knowndevs_lock);
+	vfs_biglock_acquire();
+}
+
+static
+void
+knowndevs_release_write(void)
+{
+	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
+}
+
 /*
  * Global sync function - call FSOP_SYNC on all devices.
  */
@@ -174,8 +209,16 @@ vfs_sync(void)
 {
 	struct knowndev *dev;
 	unsigned i, num;
+	bool locked;
 
-	vfs_biglock_acquire();
+	/*
+	 * We can get here from panic while in the middle of changing
+	 * knowndevs; in that case we already exclude everyone else.
+	 */
+	locked = !rwlock_do_i_hold_write(knowndevs_lock);
+	if (locked) {
+		rwlock_acquire_read(knowndevs_lock);
+	}
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -185,7 +228,9 @@ vfs_sync(void)
 		}
 	}
 
-	vfs_biglock_release();
+	if (locked) {
+		rwlock_release_read(knowndevs_lock);
+	}
 
 	return 0;
 }
@@ -401,7 +446,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 	/* Silence warning with gcc 4.8 -Og (but not -O2) */
 	index = 0;
 
-	vfs_biglock_acquire();
+	knowndevs_acquire_write();
 
 	name = kstrdup(dname);
 	if (name==NULL) {
@@ -453,7 +498,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		dev->d_devnumber = index+1;
 	}
 
-	vfs_biglock_release();
+	knowndevs_release_write();
 	return 0;
 
  fail:
@@ -470,7 +515,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		kfree(kd);
 	}
 
-	vfs_biglock_release();
+	knowndevs_release_write();
 	return result;
 }
 
@@ -543,16 +588,16 @@ vfs_mount(const char *devname, void *data,
 	struct fs *fs;
 	int result;
 
-	vfs_biglock_acquire();
+	knowndevs_acquire_write();
 
 	result = findmount(devname, &kd);
 	if (result) {
-		vfs_biglock_release();
+		knowndevs_release_write();
 		return result;
 	}
 
 	if (kd->kd_fs != NULL) {
-		vfs_biglock_release();
+		knowndevs_release_write();
 		return EBUSY;
 	}
 	KASSERT(kd->kd_rawname != NULL);
@@ -560,7 +605,7 @@ vfs_mount(const char *devname, void *data,
 
 	result = mountfunc(data, kd->kd_device, &fs);
 	if (result) {
-		vfs_biglock_release();
+		knowndevs_release_write();
 		return result;
 	}
 
@@ -573,7 +618,7 @@ vfs_mount(const char *devname, void *data,
 	kprintf("vfs: Mounted %s: on %s\n",
 		volname ? volname : kd->kd_name, kd->kd_name);
 
-	vfs_biglock_release();
+	knowndevs_release_write();
 	return 0;
 }
 
@@ -601,7 +646,7 @@ vfs_swapon(const char *devname, struct vnode **ret)
 		devname = myname;
 	}
 
-	vfs_biglock_acquire();
+	knowndevs_acquire_write();
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -622,7 +667,7 @@ vfs_swapon(const char *devname, struct vnode **ret)
 	*ret = kd->kd_vnode;
 
  out:
-	vfs_biglock_release();
+	knowndevs_release_write();
 	if (myname != NULL) {
 		kfree(myname);
 	}
@@ -640,7 +685,7 @@ vfs_unmount(const char *devname)
 	struct knowndev *kd;
 	int result;
 
-	vfs_biglock_acquire();
+	knowndevs_acquire_write();
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -673,7 +718,7 @@ vfs_unmount(const char *devname)
 	KASSERT(result==0);
 
  fail:
-	vfs_biglock_release();
+	knowndevs_release_write();
 	return result;
 }
 
@@ -690,7 +735,7 @@ vfs_swapoff(const char *devname)
 	struct knowndev *kd;
 	int result;
 
-	vfs_biglock_acquire();
+	knowndevs_acquire_write();
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -710,7 +755,7 @@ vfs_swapoff(const char *devname)
 	KASSERT(result==0);
 
  fail:
-	vfs_biglock_release();
+	knowndevs_release_write();
 	return result;
 }
 
@@ -724,7 +769,7 @@ vfs_unmountall(void)
 	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
+	knowndevs_acquire_write();
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -780,7 +825,7 @@ vfs_unmountall(void)
 		dev->kd_fs = NULL;
 	}
 
-	vfs_biglock_release();
+	knowndevs_release_write();
 
 	return 0;
 }
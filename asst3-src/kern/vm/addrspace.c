@@ -270,3 +270,24 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
         return 0;
 }
 
+/*
+ * Thread stacks are the same size as the main stack and sit below it,
+ * one slot after another, with an unmapped page between each so that
+ * an overflow faults instead of running into the next stack.
+ */
+vaddr_t
+as_threadstack(unsigned slot)
+{
+        return USERSTACK - slot * (USER_STACKPAGES + 1) * PAGE_SIZE;
+}
+
+int
+as_define_threadstack(struct addrspace *as, unsigned slot)
+{
+        KASSERT(slot > 0);
+
+        return as_define_region(as,
+                                as_threadstack(slot) - USER_STACKPAGES * PAGE_SIZE,
+                                USER_STACKPAGES * PAGE_SIZE, 1, 1, 0);
+}
+
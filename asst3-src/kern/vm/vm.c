@@ -7,6 +7,7 @@
 #include <machine/tlb.h>
 #include <proc.h>
 #include <spl.h>
+#include <trace.h>
 
 /* Place your page table functions here */
 struct page_table_entry *page_table=0;
@@ -174,6 +175,8 @@ void vm_bootstrap(void)
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
+        TRACE(TRC_VM, TRE_VMFAULT, faultaddress, faulttype);
+
         if(faulttype == VM_FAULT_READONLY){
                 panic("vm_fault: read only.\n");
                 return EFAULT;
@@ -95,12 +95,23 @@ all: includelinks .WAIT $(KERNEL)
 # The version number is kept in the file called "version" in the build
 # directory.
 #
+# ksyms.c/.o is the kernel's own symbol table, for the profiler. It
+# takes two links: the first with an empty table, to get the symbol
+# addresses out of with nm, and the second with the real table. The
+# table only adds read-only data, which comes after the code, so the
+# code addresses are the same both times.
+#
 # By immemorial tradition, "size" is run on the kernel after it's linked.
 #
 $(KERNEL):
 	$(KTOP)/conf/newvers.sh $(CONFNAME)
 	$(CC) $(KCFLAGS) -c vers.c
-	$(LD) $(KLDFLAGS) $(OBJS) vers.o -o $(KERNEL)
+	$(KTOP)/conf/newsyms.sh < /dev/null
+	$(CC) $(KCFLAGS) -c ksyms.c
+	$(LD) $(KLDFLAGS) $(OBJS) vers.o ksyms.o -o $(KERNEL)
+	$(NM) -n $(KERNEL) | $(KTOP)/conf/newsyms.sh
+	$(CC) $(KCFLAGS) -c ksyms.c
+	$(LD) $(KLDFLAGS) $(OBJS) vers.o ksyms.o -o $(KERNEL)
 	@echo '*** This is $(CONFNAME) build #'`cat version`' ***'
 	$(SIZE) $(KERNEL)
 
@@ -39,6 +39,7 @@
 #include <sys/wait.h>
 #include <assert.h>
 #include <unistd.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -72,6 +73,7 @@ static int timing = 0;
 /* array of backgrounded jobs (allows "foregrounding") */
 #define MAXBG 128
 static pid_t bgpids[MAXBG];
+static int nbg;
 
 /*
  * can_bg
@@ -105,12 +107,31 @@ remember_bg(pid_t pid)
 	for (i = 0; i < MAXBG; i++) {
 		if (bgpids[i] == 0) {
 			bgpids[i] = pid;
+			nbg++;
 			return;
 		}
 	}
 	assert(0);
 }
 
+/*
+ * forgetbg
+ * removes a pid from the background array, if it's there.
+ */
+static
+void
+forgetbg(pid_t pid)
+{
+	int i;
+	for (i = 0; i < MAXBG; i++) {
+		if (bgpids[i] == pid) {
+			bgpids[i] = 0;
+			nbg--;
+			return;
+		}
+	}
+}
+
 /*
  * constructor for exitinfo
  */
@@ -211,45 +232,22 @@ dowait(pid_t pid)
 
 #ifdef WNOHANG
 /*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
+ * waitpoll
+ * collect any background jobs that have exited.
  */
 static
-int
-dowaitpoll(pid_t pid)
+void
+waitpoll(void)
 {
 	struct exitinfo ei;
-	pid_t foundpid;
+	pid_t pid;
 	int status;
 
-	foundpid = waitpid(pid, &status, WNOHANG);
-	if (foundpid < 0) {
-		warn("pid %d", pid);
-	}
-	else if (foundpid != 0) {
+	while ((pid = waitpid(WAIT_ANY, &status, WNOHANG)) > 0) {
 		printf("pid %d: ", pid);
 		readstatus(status, &ei);
 		printstatus(&ei, 1);
-		return 1;
-	}
-	return 0;
-}
-
-/*
- * waitpoll
- * poll all background jobs for having exited.
- */
-static
-void
-waitpoll(void)
-{
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
-				bgpids[i] = 0;
-			}
-		}
+		forgetbg(pid);
 	}
 }
 #endif /* WNOHANG */
@@ -264,26 +262,29 @@ static
 void
 cmd_wait(int ac, char *av[], struct exitinfo *ei)
 {
-	int i;
+	struct exitinfo jobei;
 	pid_t pid;
+	int status;
 
 	if (ac == 2) {
 		pid = atoi(av[1]);
 		dowait(pid);
-		for (i = 0; i < MAXBG; i++) {
-			if (bgpids[i]==pid) {
-				bgpids[i] = 0;
-			}
-		}
+		forgetbg(pid);
 		exitinfo_exit(ei, 0);
 		return;
 	}
 	else if (ac == 1) {
-		for (i=0; i < MAXBG; i++) {
-			if (bgpids[i] != 0) {
-				dowait(bgpids[i]);
-				bgpids[i] = 0;
+		/* Report the jobs in the order they finish. */
+		while (nbg > 0) {
+			pid = waitpid(WAIT_ANY, &status, 0);
+			if (pid < 0) {
+				warn("wait");
+				break;
 			}
+			printf("pid %d: ", pid);
+			readstatus(status, &jobei);
+			printstatus(&jobei, 1);
+			forgetbg(pid);
 		}
 		exitinfo_exit(ei, 0);
 		return;
@@ -421,27 +422,16 @@ docommand(char *buf, struct exitinfo *ei)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
+	/*
+	 * Start the program with spawn, which doesn't copy the shell's
+	 * address space, and reports failure to load the program
+	 * directly.
+	 */
+	pid = spawnp(args[0], args, NULL, 0);
+	if (pid < 0) {
+		warn("%s", args[0]);
+		exitinfo_exit(ei, 1);
+		return;
 	}
 
 	/* parent */
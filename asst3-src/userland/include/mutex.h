@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _MUTEX_H_
+#define _MUTEX_H_
+
+/*
+ * OS/161-specific: mutexes and condition variables for user threads
+ * (see threadfork). They are built on the futex_wait and futex_wake
+ * system calls and only enter the kernel when a thread has to sleep
+ * or there is a sleeper to wake.
+ *
+ * Condition variable waits may return spuriously; always recheck
+ * the condition in a loop.
+ */
+
+struct mutex {
+	volatile int m_state;	/* 0 free, 1 held, 2 held with waiters */
+};
+
+struct condvar {
+	volatile int cv_seq;	/* bumped by every signal/broadcast */
+	volatile int cv_waiters;/* threads in condvar_wait */
+};
+
+#define MUTEX_INITIALIZER   { 0 }
+#define CONDVAR_INITIALIZER { 0, 0 }
+
+void mutex_init(struct mutex *m);
+void mutex_lock(struct mutex *m);
+int mutex_trylock(struct mutex *m);	/* returns 0 if it got the lock */
+void mutex_unlock(struct mutex *m);
+
+void condvar_init(struct condvar *cv);
+void condvar_wait(struct condvar *cv, struct mutex *m);
+void condvar_signal(struct condvar *cv);
+void condvar_broadcast(struct condvar *cv);
+
+#endif /* _MUTEX_H_ */
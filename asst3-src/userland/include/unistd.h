@@ -112,6 +112,7 @@
 __DEAD void _exit(int code);
 int execv(const char *prog, char *const *args);
 pid_t fork(void);
+pid_t vfork(void);	/* child borrows our memory until it execs or exits */
 pid_t waitpid(pid_t pid, int *returncode, int flags);
 /*
  * Open actually takes either two or three args: the optional third
@@ -147,7 +148,13 @@ ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
+int __threadfork(void (*start)(void (*)(void)), void (*func)(void));
+__DEAD void threadexit(int status);
+int threadjoin(int tid, int *status);
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int n);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -158,6 +165,7 @@ ssize_t __getcwd(char *buf, size_t buflen);
 int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int threadfork(void (*func)(void));		/* calls __threadfork */
 
 /* UNSW versions of mmap() and munmap()
  * This are simplified compared to the standard version on UNIX
@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <spawn.h>
 
 /*
  * system(): ANSI C
@@ -74,18 +75,11 @@ system(const char *cmd)
 
 	argv[nargs] = NULL;
 
-	pid = fork();
-	switch (pid) {
-	    case -1:
+	/* spawn fails (with errno set) if the program can't be run */
+	pid = spawn(argv[0], argv, NULL, 0);
+	if (pid < 0) {
 		return -1;
-	    case 0:
-		/* child */
-		execv(argv[0], argv);
-		/* exec only returns if it fails */
-		_exit(255);
-	    default:
-		/* parent */
-		waitpid(pid, &status, 0);
-		return status;
 	}
+	waitpid(pid, &status, 0);
+	return status;
 }
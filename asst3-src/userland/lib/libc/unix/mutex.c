@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <unistd.h>
+#include <errno.h>
+#include <mutex.h>
+
+/*
+ * OS/161-specific: user-level mutexes and condition variables on top
+ * of futex_wait/futex_wake.
+ *
+ * The mutex is the usual three-state futex lock: 0 is free, 1 is held
+ * with nobody waiting, 2 is held with possible waiters. Locking and
+ * unlocking an uncontended mutex is one atomic instruction each and
+ * no system call; only the 2 state makes unlock call futex_wake.
+ */
+
+/*
+ * Atomic operations using LL/SC, in the same style as the kernel's
+ * spinlock_data_testandset. Each returns the old value.
+ */
+
+static
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		".set noreorder;"	/* we fill the delay slots */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"bne %0, %3, 2f;"	/*   give up if x != old */
+		" move %1, %4;"		/*   y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		" nop;"
+		"2:;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return x;
+}
+
+static
+int
+atomic_xchg(volatile int *p, int new)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"move %1, %3;"		/*   y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (p), "r" (new) : "memory");
+	return x;
+}
+
+static
+int
+atomic_add(volatile int *p, int n)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"addu %1, %0, %3;"	/*   y = x + n */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (p), "r" (n) : "memory");
+	return x;
+}
+
+////////////////////////////////////////////////////////////
+// mutex
+
+void
+mutex_init(struct mutex *m)
+{
+	m->m_state = 0;
+}
+
+/*
+ * Take the lock the slow way, marking it contended. Used both after
+ * a failed fast path and for reacquiring after a condvar wait, when
+ * there may well be other sleepers.
+ */
+static
+void
+mutex_lock_contended(struct mutex *m, int c)
+{
+	if (c != 2) {
+		c = atomic_xchg(&m->m_state, 2);
+	}
+	while (c != 0) {
+		futex_wait(&m->m_state, 2);
+		c = atomic_xchg(&m->m_state, 2);
+	}
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+	int c;
+
+	c = atomic_cas(&m->m_state, 0, 1);
+	if (c != 0) {
+		mutex_lock_contended(m, c);
+	}
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+	if (atomic_cas(&m->m_state, 0, 1) != 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+	return 0;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+	if (atomic_add(&m->m_state, -1) != 1) {
+		/* It was 2: somebody may be asleep. */
+		m->m_state = 0;
+		futex_wake(&m->m_state, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// condition variable
+
+/*
+ * A waiter samples cv_seq before dropping the mutex and sleeps only
+ * if it hasn't changed, so a signal between the unlock and the
+ * futex_wait isn't lost. cv_waiters lets signal and broadcast skip
+ * the system call when nobody is waiting; the waiter counts itself
+ * before sampling cv_seq and the signaller bumps cv_seq before
+ * checking cv_waiters, so at least one of them sees the other.
+ */
+
+void
+condvar_init(struct condvar *cv)
+{
+	cv->cv_seq = 0;
+	cv->cv_waiters = 0;
+}
+
+void
+condvar_wait(struct condvar *cv, struct mutex *m)
+{
+	int seq;
+
+	atomic_add(&cv->cv_waiters, 1);
+	seq = cv->cv_seq;
+	mutex_unlock(m);
+	futex_wait(&cv->cv_seq, seq);
+	atomic_add(&cv->cv_waiters, -1);
+	mutex_lock_contended(m, 0);
+}
+
+void
+condvar_signal(struct condvar *cv)
+{
+	atomic_add(&cv->cv_seq, 1);
+	if (cv->cv_waiters > 0) {
+		futex_wake(&cv->cv_seq, 1);
+	}
+}
+
+void
+condvar_broadcast(struct condvar *cv)
+{
+	atomic_add(&cv->cv_seq, 1);
+	if (cv->cv_waiters > 0) {
+		futex_wake(&cv->cv_seq, cv->cv_waiters);
+	}
+}
@@ -43,24 +43,24 @@
 static char *hargv[2] = { (char *)"hog", NULL };
 static char *cargv[3] = { (char *)"cat", (char *)"catfile", NULL };
 
-#define MAXPROCS  6
-static int pids[MAXPROCS], npids;
+static int npids;
 
 static
 void
 spawnv(const char *prog, char **argv)
 {
-	int pid = fork();
+	int pid = vfork();
 	switch (pid) {
 	    case -1:
-		err(1, "fork");
+		err(1, "vfork");
 	    case 0:
-		/* child */
+		/* child; shares our memory, so must not call exit() */
 		execv(prog, argv);
-		err(1, "%s", prog);
+		warn("%s", prog);
+		_exit(1);
 	    default:
 		/* parent */
-		pids[npids++] = pid;
+		npids++;
 		break;
 	}
 }
@@ -70,15 +70,19 @@ void
 waitall(void)
 {
 	int i, status;
+	pid_t pid;
+
+	/* Collect the children in whatever order they finish. */
 	for (i=0; i<npids; i++) {
-		if (waitpid(pids[i], &status, 0)<0) {
-			warn("waitpid for %d", pids[i]);
+		pid = waitpid(WAIT_ANY, &status, 0);
+		if (pid < 0) {
+			warn("waitpid");
 		}
 		else if (WIFSIGNALED(status)) {
-			warnx("pid %d: signal %d", pids[i], WTERMSIG(status));
+			warnx("pid %d: signal %d", pid, WTERMSIG(status));
 		}
 		else if (WEXITSTATUS(status) != 0) {
-			warnx("pid %d: exit %d", pids[i], WEXITSTATUS(status));
+			warnx("pid %d: exit %d", pid, WEXITSTATUS(status));
 		}
 	}
 }
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * mutextest - test the libc mutex and condvar.
+ *
+ * NTHREADS threads each increment a shared counter NINCS times under
+ * a mutex; any lost update means mutual exclusion failed. Then a
+ * bounded buffer is run between a producer and a consumer with two
+ * condvars, checking that every item arrives once and in order.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+#include <mutex.h>
+
+#define NTHREADS	4
+#define NINCS		10000
+#define NITEMS		5000
+#define BUFSIZE		4
+
+static struct mutex lock = MUTEX_INITIALIZER;
+static volatile int counter;
+
+static struct condvar notfull = CONDVAR_INITIALIZER;
+static struct condvar notempty = CONDVAR_INITIALIZER;
+static int buf[BUFSIZE];
+static int head, count;
+
+static
+void
+incthread(void)
+{
+	int i, tmp;
+
+	for (i = 0; i < NINCS; i++) {
+		mutex_lock(&lock);
+		tmp = counter;
+		/* Widen the window for a race. */
+		if (i % 100 == 0) {
+			getpid();
+		}
+		counter = tmp + 1;
+		mutex_unlock(&lock);
+	}
+}
+
+static
+void
+producer(void)
+{
+	int i;
+
+	for (i = 0; i < NITEMS; i++) {
+		mutex_lock(&lock);
+		while (count == BUFSIZE) {
+			condvar_wait(&notfull, &lock);
+		}
+		buf[(head + count) % BUFSIZE] = i;
+		count++;
+		condvar_signal(&notempty);
+		mutex_unlock(&lock);
+	}
+}
+
+static
+void
+consumer(void)
+{
+	int i, item;
+
+	for (i = 0; i < NITEMS; i++) {
+		mutex_lock(&lock);
+		while (count == 0) {
+			condvar_wait(&notempty, &lock);
+		}
+		item = buf[head];
+		head = (head + 1) % BUFSIZE;
+		count--;
+		condvar_signal(&notfull);
+		mutex_unlock(&lock);
+		if (item != i) {
+			errx(1, "consumer: got item %d, expected %d", item, i);
+		}
+	}
+}
+
+static
+void
+join(int tid)
+{
+	int status;
+
+	if (threadjoin(tid, &status) < 0) {
+		err(1, "threadjoin %d", tid);
+	}
+	if (status != 0) {
+		errx(1, "thread %d exited with %d", tid, status);
+	}
+}
+
+int
+main(void)
+{
+	int tids[NTHREADS];
+	int i;
+
+	if (mutex_trylock(&lock) != 0) {
+		errx(1, "trylock of a free mutex failed");
+	}
+	if (mutex_trylock(&lock) == 0) {
+		errx(1, "trylock of a held mutex succeeded");
+	}
+	mutex_unlock(&lock);
+
+	for (i = 0; i < NTHREADS; i++) {
+		tids[i] = threadfork(incthread);
+		if (tids[i] < 0) {
+			err(1, "threadfork");
+		}
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		join(tids[i]);
+	}
+	if (counter != NTHREADS * NINCS) {
+		errx(1, "counter is %d, expected %d", counter,
+		     NTHREADS * NINCS);
+	}
+
+	tids[0] = threadfork(consumer);
+	if (tids[0] < 0) {
+		err(1, "threadfork");
+	}
+	tids[1] = threadfork(producer);
+	if (tids[1] < 0) {
+		err(1, "threadfork");
+	}
+	join(tids[0]);
+	join(tids[1]);
+
+	printf("mutextest: passed\n");
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * rusage - test getrusage.
+ *
+ * Spins for a while and checks that it was charged some user time,
+ * then forks a child that does the same and checks that once the
+ * child has been collected with waitpid its time shows up under
+ * RUSAGE_CHILDREN. Times have hardclock resolution, so the spins
+ * are made long enough to span many ticks.
+ */
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+#define SPINS	4000000
+
+static volatile unsigned counter;
+
+static
+void
+spin(void)
+{
+	unsigned i;
+
+	for (i = 0; i < SPINS; i++) {
+		counter++;
+	}
+}
+
+static
+unsigned long
+usecs(const struct timeval *tv)
+{
+	return (unsigned long)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static
+void
+show(const char *what, const struct rusage *ru)
+{
+	printf("%s: user %lu us, system %lu us, %lu vcsw, %lu ivcsw\n",
+	       what, usecs(&ru->ru_utime), usecs(&ru->ru_stime),
+	       (unsigned long)ru->ru_nvcsw, (unsigned long)ru->ru_nivcsw);
+}
+
+int
+main(void)
+{
+	struct rusage self, kids;
+	pid_t pid;
+	int status;
+
+	if (getrusage(RUSAGE_CHILDREN, &kids) < 0) {
+		err(1, "getrusage(RUSAGE_CHILDREN)");
+	}
+	if (usecs(&kids.ru_utime) != 0 || usecs(&kids.ru_stime) != 0) {
+		errx(1, "Child time before there were any children");
+	}
+
+	spin();
+	if (getrusage(RUSAGE_SELF, &self) < 0) {
+		err(1, "getrusage(RUSAGE_SELF)");
+	}
+	show("self", &self);
+	if (usecs(&self.ru_utime) == 0) {
+		errx(1, "No user time after spinning");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		spin();
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (getrusage(RUSAGE_CHILDREN, &kids) < 0) {
+		err(1, "getrusage(RUSAGE_CHILDREN)");
+	}
+	show("children", &kids);
+	if (usecs(&kids.ru_utime) == 0) {
+		errx(1, "No child user time after collecting a child");
+	}
+
+	if (getrusage(12345, &self) == 0) {
+		errx(1, "getrusage with a bad who succeeded");
+	}
+
+	printf("rusage: passed\n");
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * spawntest - test spawn.
+ *
+ * 1. Spawn /testbin/add with its standard output redirected to a
+ *    file by a SPAWN_OPEN action; check that the file holds its
+ *    answer.
+ * 2. Spawning a program that doesn't exist fails in the parent,
+ *    with no child left behind for waitpid(WAIT_ANY) to find.
+ * 3. A bad file action also fails synchronously.
+ */
+
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <spawn.h>
+#include <err.h>
+
+#define OUTFILE "spawntest.out"
+
+int
+main(void)
+{
+	static char *addargv[] = { (char *)"add", (char *)"3", (char *)"4",
+				   NULL };
+	static char *badargv[] = { (char *)"nonexistent", NULL };
+	struct spawn_action act;
+	char buf[64];
+	pid_t pid, found;
+	int status, fd;
+	ssize_t len;
+
+	/* 1. Redirected output. */
+	act.sa_op = SPAWN_OPEN;
+	act.sa_fd = STDOUT_FILENO;
+	act.sa_arg = O_WRONLY|O_CREAT|O_TRUNC;
+	act.sa_path = OUTFILE;
+	pid = spawn("/testbin/add", addargv, &act, 1);
+	if (pid < 0) {
+		err(1, "spawn /testbin/add");
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "/testbin/add failed");
+	}
+	fd = open(OUTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", OUTFILE);
+	}
+	len = read(fd, buf, sizeof(buf) - 1);
+	if (len < 0) {
+		err(1, "%s: read", OUTFILE);
+	}
+	buf[len] = 0;
+	close(fd);
+	remove(OUTFILE);
+	if (strcmp(buf, "Answer: 7\n") != 0) {
+		errx(1, "Wrong output from /testbin/add: %s", buf);
+	}
+	printf("spawntest: redirect ok\n");
+
+	/* 2. Nonexistent program. */
+	pid = spawn("/nonexistent", badargv, NULL, 0);
+	if (pid >= 0) {
+		errx(1, "spawn of /nonexistent succeeded");
+	}
+	warn("spawn /nonexistent (expected)");
+
+	/*
+	 * The only child waitpid can find now should be the next one
+	 * we spawn, and after collecting that there should be none.
+	 */
+	pid = spawn("/testbin/add", addargv, NULL, 0);
+	if (pid < 0) {
+		err(1, "spawn /testbin/add");
+	}
+	found = waitpid(WAIT_ANY, &status, 0);
+	if (found < 0) {
+		err(1, "waitpid");
+	}
+	if (found != pid) {
+		errx(1, "Child %d left behind by failed spawn", found);
+	}
+	if (waitpid(WAIT_ANY, &status, WNOHANG) >= 0 || errno != ECHILD) {
+		errx(1, "Child left behind by failed spawn");
+	}
+	printf("spawntest: failed spawn ok\n");
+
+	/* 3. Bad file action. */
+	act.sa_op = SPAWN_DUP2;
+	act.sa_fd = STDOUT_FILENO;
+	act.sa_arg = 99;
+	pid = spawn("/testbin/add", addargv, &act, 1);
+	if (pid >= 0) {
+		errx(1, "spawn with bad dup2 succeeded");
+	}
+	warn("spawn with bad dup2 (expected)");
+
+	printf("spawntest: passed\n");
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * threadjoin - test threadfork and threadjoin.
+ *
+ * Starts NTHREADS threads that each sum a slice of an array, and
+ * joins them all, checking their results and exit statuses. The last
+ * thread returns from its function instead of calling threadexit, so
+ * it should exit with status 0.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+#define NTHREADS	4
+#define SLICE		50000
+
+static volatile int data[NTHREADS * SLICE];
+static volatile int sums[NTHREADS];
+
+static
+int
+sumslice(int n)
+{
+	int i, sum = 0;
+
+	for (i = n * SLICE; i < (n + 1) * SLICE; i++) {
+		sum += data[i];
+	}
+	return sum;
+}
+
+static void worker0(void) { sums[0] = sumslice(0); threadexit(100); }
+static void worker1(void) { sums[1] = sumslice(1); threadexit(101); }
+static void worker2(void) { sums[2] = sumslice(2); threadexit(102); }
+static void worker3(void) { sums[3] = sumslice(3); }
+
+static void (*const workers[NTHREADS])(void) = {
+	worker0, worker1, worker2, worker3,
+};
+
+int
+main(void)
+{
+	int tids[NTHREADS];
+	int i, status, expected;
+
+	for (i = 0; i < NTHREADS * SLICE; i++) {
+		data[i] = i % 7;
+	}
+
+	for (i = 0; i < NTHREADS; i++) {
+		tids[i] = threadfork(workers[i]);
+		if (tids[i] < 0) {
+			err(1, "threadfork");
+		}
+	}
+
+	for (i = 0; i < NTHREADS; i++) {
+		if (threadjoin(tids[i], &status) < 0) {
+			err(1, "threadjoin %d", tids[i]);
+		}
+		expected = (i < NTHREADS - 1) ? 100 + i : 0;
+		if (status != expected) {
+			errx(1, "thread %d: status %d, expected %d",
+			     tids[i], status, expected);
+		}
+		if (sums[i] != sumslice(i)) {
+			errx(1, "thread %d: wrong sum %d", tids[i], sums[i]);
+		}
+	}
+
+	if (threadjoin(tids[0], &status) == 0) {
+		errx(1, "joined thread %d twice", tids[0]);
+	}
+
+	printf("threadjoin: passed\n");
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * vforktest - test vfork.
+ *
+ * 1. The child runs in the parent's memory: a value it stores is
+ *    there when the parent resumes, which isn't until the child has
+ *    exited.
+ * 2. A child that execs releases the parent; the exec'd program
+ *    (/testbin/add) runs and its exit status comes back through
+ *    waitpid as usual.
+ * 3. A child that fails to exec can still _exit.
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+static volatile int shared;
+
+static
+int
+collect(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status)) {
+		errx(1, "pid %d: did not exit normally", pid);
+	}
+	return WEXITSTATUS(status);
+}
+
+int
+main(void)
+{
+	static char *addargv[] = { (char *)"add", (char *)"3", (char *)"4",
+				   NULL };
+	static char *badargv[] = { (char *)"nonexistent", NULL };
+	pid_t pid;
+
+	/* 1. Shared memory, parent waits. */
+	shared = 0;
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		shared = 1;
+		_exit(7);
+	}
+	if (shared != 1) {
+		errx(1, "Parent didn't see the child's store");
+	}
+	if (collect(pid) != 7) {
+		errx(1, "Wrong exit status from child");
+	}
+	printf("vforktest: shared memory ok\n");
+
+	/* 2. Exec. */
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		execv("/testbin/add", addargv);
+		_exit(100);
+	}
+	if (collect(pid) == 100) {
+		errx(1, "execv of /testbin/add failed");
+	}
+	printf("vforktest: exec ok\n");
+
+	/* 3. Failed exec. */
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		execv("/nonexistent", badargv);
+		_exit(101);
+	}
+	if (collect(pid) != 101) {
+		errx(1, "Wrong exit status after failed execv");
+	}
+
+	printf("vforktest: passed\n");
+	return 0;
+}